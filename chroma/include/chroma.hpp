@@ -13,6 +13,14 @@
 #include <limits>
 #include <exception>
 #include <vision.hpp>
+#include <preprocessing.hpp>
+#include <roi_planner.hpp>
+#include <image_bridge.hpp>
+#include <frame_policy.hpp>
+#include <profile_diagnostics.hpp>
+#include <ros_visual_msgs/FrameTrace.h>
+#include <ros_visual_msgs/TrackRegions.h>
+#include <ros_visual_msgs/MotionBoxes.h>
 #include "radio_services/InstructionWithAnswer.h"
 
 using namespace std;
@@ -22,11 +30,12 @@ class Chroma_processing
 {
 	public:
 				
-		Chroma_processing();
+		Chroma_processing(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle local_nh = ros::NodeHandle("~"));
 		~Chroma_processing();
 		
 		//image and depth callbacks
 		void imageCb(const sensor_msgs::ImageConstPtr& msg);
+		void regionsCb(const ros_visual_msgs::TrackRegionsConstPtr& msg);
 		bool nodeStateCallback(radio_services::InstructionWithAnswer::Request &req, radio_services::InstructionWithAnswer::Response &res);
 		
 		
@@ -35,6 +44,14 @@ class Chroma_processing
 		ros::NodeHandle nh_;		
 		image_transport::ImageTransport it_;
 		image_transport::Subscriber image_sub;
+		ros::Subscriber regions_sub;
+		ros::Publisher diagnostics_pub;
+		ros::Publisher trace_pub;
+		ros::Publisher boxes_pub;
+		FramePolicy frame_policy;
+		FrameMonitor frame_monitor;
+		Profiler profiler;
+		ProfileReporter profile_reporter;
 		image_transport::Publisher image_pub;
 		image_transport::Publisher image_pub_dif;
 		ros::ServiceServer service;
@@ -43,24 +60,41 @@ class Chroma_processing
 		string image_topic;
 		string image_out_topic;
 		string image_out_dif_topic;
+		string roi_topic;
+		string motion_boxes_topic;
 		
 		
-		Mat ref_rgb;
-		Mat dif_rgb;
+		sensor_msgs::ImagePtr image_msg;
+		sensor_msgs::ImagePtr dif_msg;
+		CopyStats copy_stats;
 		
 		vector< Rect_<int> > rgb_rects;
 		
+		ImagePreprocessor preprocessor;
+		MotionDetector motion;
+		
+		//Region of interest mode, the processed frame is kept between frames
+		RoiPlanner planner;
+		vector< Rect_<int> > regions;
+		Mat processed;
+		
 		bool playback_topics;
 		bool display;
 		bool has_image = false;
+		bool roi_mode = false;
 		
-		int rows;
-		int cols;
-		int size;
-		int channels;
+		int rows = 0;
+		int cols = 0;
+		int size = 0;
+		int channels = 0;
 		int interval = 5;
 		int myThreshold  = 100;
 		float backFactor = 0.80;
+		double gamma;
+		double clahe_clip_limit;
+		int clahe_tiles;
+		int motion_scale;
+		int blob_range = 15;
 		
 		long curTime ;
 		
@@ -1,10 +1,9 @@
 #include <chroma.hpp>
 
-Chroma_processing::Chroma_processing()
-: it_(nh_)
+Chroma_processing::Chroma_processing(ros::NodeHandle nh, ros::NodeHandle local_nh)
+: nh_(nh), it_(nh_)
 {
 	//Getting the parameters specified by the launch file 
-	ros::NodeHandle local_nh("~");
 	local_nh.param("image_topic"		 , image_topic		   , string("/camera/rgb/image_raw"));
 	local_nh.param("image_out_topic"	 , image_out_topic	   , string("/chroma_proc/image"));
 	local_nh.param("image_out_dif_topic" , image_out_dif_topic , string("/chroma_proc/image_dif"));
@@ -12,17 +11,59 @@ Chroma_processing::Chroma_processing()
 	local_nh.param("playback_topics"	 , playback_topics	   , false);
 	local_nh.param("display"			 , display	 		   , false);
 	local_nh.param("run_on_start"		 , running			   , false);
+	local_nh.param("gamma"				 , gamma			   , 2.5);
+	local_nh.param("clahe_clip_limit"	 , clahe_clip_limit	   , 1.5);
+	local_nh.param("clahe_tiles"		 , clahe_tiles		   , 10);
+	local_nh.param("motion_scale"		 , motion_scale		   , 1);
+	local_nh.param("motion_boxes_topic"	 , motion_boxes_topic  , string("/ros_visual/motion_boxes"));
+	motion_scale = max(motion_scale, 1);
+	
+	//The preprocessing stage keeps its lookup table and CLAHE instance between frames
+	preprocessor.setGamma(gamma);
+	preprocessor.setClahe(clahe_clip_limit, clahe_tiles);
+	//Above 1 the background and the published difference are motion_scale
+	//times smaller than the frame. The blobs are detected here and refined at
+	//full resolution, fusion tracks them and infers the scale from their frame
+	motion = MotionDetector(backFactor, 255*0.33, motion_scale);
+	if(motion_scale > 1)
+		boxes_pub = nh_.advertise<ros_visual_msgs::MotionBoxes>(motion_boxes_topic, 10);
+	
+	//Region of interest mode, the per pixel stages run around the boxes
+	//tracked by fusion with a whole frame sweep every roi_sweep_period frames
+	RoiParams roi;
+	local_nh.param("roi_mode"			 , roi_mode			   , false);
+	local_nh.param("roi_topic"			 , roi_topic		   , string("/ros_visual/track_regions"));
+	local_nh.param("roi_margin"			 , roi.margin		   , 16);
+	local_nh.param("roi_sweep_period"	 , roi.sweep_period	   , 15);
+	local_nh.param("roi_stable_frames"	 , roi.stable_frames   , 5);
+	local_nh.param("roi_max_age"		 , roi.max_age		   , 0.5);
+	local_nh.param("roi_max_coverage"	 , roi.max_coverage	   , 0.6f);
+	planner.setParams(roi);
+	if(roi_mode)
+		regions_sub = nh_.subscribe(roi_topic, 1, &Chroma_processing::regionsCb, this);
+	
+	//Backpressure of the image subscription and its counters
+	frame_policy 	= FramePolicy::fromParams(local_nh);
+	frame_monitor 	= FrameMonitor("ros_visual/chroma", frame_policy);
+	diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	trace_pub 		= nh_.advertise<ros_visual_msgs::FrameTrace>("/ros_visual/trace", 10);
+	
+	//Stage latencies, published on the same topic
+	double profiling_period;
+	local_nh.param("profiling"		 , profiler.enabled , false);
+	local_nh.param("profiling_period", profiling_period , 5.0);
+	profile_reporter = ProfileReporter("ros_visual/chroma", profiling_period);
 	
 	if(playback_topics && running)
 	{
 		ROS_INFO_STREAM_NAMED("Chroma_processing","Subscribing at compressed topics \n"); 
 		
-		image_sub = it_.subscribe(image_topic, 1, 
+		image_sub = it_.subscribe(image_topic, frame_policy.subscriberQueue(), 
 		  &Chroma_processing::imageCb, this, image_transport::TransportHints("compressed"));
 	}
 	else{
 		if(running){
-			image_sub = it_.subscribe(image_topic, 1, &Chroma_processing::imageCb, this);
+			image_sub = it_.subscribe(image_topic, frame_policy.subscriberQueue(), &Chroma_processing::imageCb, this);
 		}
 	}
 
@@ -50,11 +91,20 @@ Chroma_processing::~Chroma_processing()
  */
 void Chroma_processing::imageCb(const sensor_msgs::ImageConstPtr& msg)
 {
-	cv_bridge::CvImagePtr cv_ptr;
+	ros::Time received = ros::Time::now();
+	cv_bridge::CvImageConstPtr cv_ptr;
 	
+	bool process = frame_monitor.accept(msg->header);
+	frame_monitor.publish(diagnostics_pub);
+	if(!process)
+		return;
+	
+	ScopedTimer frame_timer(&profiler, STAGE_FRAME);
+	ScopedTimer timer(&profiler, STAGE_DECODE);
 	try
 	{
-	  cv_ptr = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::MONO8);	  
+	  //Shares the message buffer, copies only if a conversion to mono8 is needed
+	  cv_ptr = shareImage(msg, sensor_msgs::image_encodings::MONO8, copy_stats);	  
 	}
 	catch (cv_bridge::Exception& e)
 	{
@@ -62,38 +112,57 @@ void Chroma_processing::imageCb(const sensor_msgs::ImageConstPtr& msg)
 	  return;
 	}
 
-	Mat cur_rgb = (cv_ptr->image);
+	const Mat& in_rgb = (cv_ptr->image);
+	
+	//The results are written straight into the outgoing messages
+	Mat cur_rgb = prepareImage(image_msg, msg->header, in_rgb.rows, in_rgb.cols, CV_8UC1, sensor_msgs::image_encodings::MONO8);
+	Mat dif_rgb = prepareImage(dif_msg, msg->header, in_rgb.rows/motion_scale, in_rgb.cols/motion_scale, CV_8UC1, sensor_msgs::image_encodings::MONO8);
 	
 	//~ equalizeHist( cur_rgb, cur_rgb );
 	//~ cur_rgb.convertTo(cur_rgb, -1, 1.2, 0);
-	Ptr<CLAHE> clahe = createCLAHE();
-	clahe->setClipLimit(1.5);
-	clahe->setTilesGridSize(Size(10, 10));
 	
-	// gamma correction
-	gammaCorrection(cur_rgb, 2.5);
-	clahe->apply(cur_rgb, cur_rgb);
+	// gamma correction and CLAHE, in ROI mode only inside the planned regions
+	// of the kept frame, the rest of it holds its last processed value
+	timer.next(STAGE_PREPROCESS);
+	bool regions_only = roi_mode && planner.plan(in_rgb.size(), preprocessor.tileSize(in_rgb.size()), msg->header.stamp.toSec(), regions);
+	if(regions_only)
+		preprocessor.applyRegions(in_rgb, processed, regions);
+	else if(roi_mode)
+		preprocessor.apply(in_rgb, processed);
+	else
+		preprocessor.apply(in_rgb, cur_rgb);
+	if(roi_mode)
+		processed.copyTo(cur_rgb);
 
 	// First run variable initialization 
-	if(ref_rgb.rows == 0)
+	if(rows == 0)
 	{
 		rows 	 = cur_rgb.rows;
 		cols 	 = cur_rgb.cols;
 		channels = cur_rgb.channels();
 		size 	 = rows*cols*channels;
-		ref_rgb  = cur_rgb.clone();
 	}
 	
-	//Calculating image difference between the current and previous images
-	frameDif(cur_rgb, ref_rgb, dif_rgb, 255*0.33);
-
-	for(int y = 0; y < 1; ++y)
+	//Calculating image difference between the current and reference images
+	//and updating the running average of the reference in the same pass
+	timer.next(STAGE_BACKGROUND);
+	if(regions_only)
+		motion.applyRegions(cur_rgb, dif_rgb, regions);
+	else
+		motion.apply(cur_rgb, dif_rgb);
+	
+	//Pyramid mode, the blobs of the coarse difference refined around the
+	//pixels of the full resolution frame that moved
+	if(motion_scale > 1)
 	{
-		uchar* cur = cur_rgb.ptr<uchar>(y);
-		uchar* ref = ref_rgb.ptr<uchar>(y);
-		for(int x = 0; x < size; ++x)
-			ref[x] = cur[x]*(1-backFactor)+ ref[x]*backFactor;
+		timer.next(STAGE_BLOBS);
+		rgb_rects.clear();
+		detectBlobs(dif_rgb, rgb_rects, max(blob_range/motion_scale, 1), 1, false);
+		motion.refine(cur_rgb, rgb_rects, blob_range);
 	}
+	timer.stop();
+	if(roi_mode)
+		ROS_DEBUG_THROTTLE(5, "Chroma_processing: %.0f%% of the frame area processed", 100*planner.occupancy());
 	if(display)
 	{
 		//Blob detection
@@ -106,7 +175,7 @@ void Chroma_processing::imageCb(const sensor_msgs::ImageConstPtr& msg)
 
 		
 		//Display
-		imshow("dif_rgb", ref_rgb);
+		imshow("dif_rgb", motion.reference());
 		moveWindow("dif_rgb", 0, 0);
 		imshow("cur_rgb", cur_rgb);
 		moveWindow("cur_rgb", 645, 0);
@@ -152,13 +221,68 @@ void Chroma_processing::imageCb(const sensor_msgs::ImageConstPtr& msg)
 	
 	has_image = true;
 	
+	//Hop of the frame, fusion attaches it to the results. Published ahead
+	//of the images so it is already queued when fusion handles them
+	timer.next(STAGE_PUBLISH);
+	if(trace_pub.getNumSubscribers() > 0)
+	{
+		ros_visual_msgs::FrameTrace trace;
+		ros_visual_msgs::FrameHop hop;
+		hop.node 	  = "chroma";
+		hop.received  = received;
+		hop.published = ros::Time::now();
+		trace.header  = msg->header;
+		trace.hops.push_back(hop);
+		trace_pub.publish(trace);
+	}
+	
+	//Refined blobs, ahead of the difference for the same reason
+	if(motion_scale > 1)
+	{
+		ros_visual_msgs::MotionBoxes boxes;
+		boxes.header = msg->header;
+		boxes.width  = cur_rgb.cols;
+		boxes.height = cur_rgb.rows;
+		boxes.boxes.resize(rgb_rects.size());
+		for(int i = 0; i < rgb_rects.size(); ++i)
+		{
+			boxes.boxes[i].x 	  = rgb_rects[i].x;
+			boxes.boxes[i].y 	  = rgb_rects[i].y;
+			boxes.boxes[i].width  = rgb_rects[i].width;
+			boxes.boxes[i].height = rgb_rects[i].height;
+		}
+		boxes_pub.publish(boxes);
+	}
+	
 	//Publish processed image
-	cv_ptr->image = cur_rgb;
-	image_pub.publish(cv_ptr->toImageMsg());
+	image_pub.publish(image_msg);
 	
 	//Publish image difference
-	cv_ptr->image = dif_rgb;
-	image_pub_dif.publish(cv_ptr->toImageMsg());
+	image_pub_dif.publish(dif_msg);
+	timer.stop();
+	frame_timer.stop();
+	profile_reporter.publish(profiler, diagnostics_pub);
+	
+	copy_stats.endFrame();
+	ROS_DEBUG_THROTTLE(5, "Chroma_processing: %lu bytes copied in the last frame", (unsigned long)copy_stats.last_frame_bytes);
+}
+
+/* Callback of the boxes tracked by fusion, the regions of the next frames
+ * 
+ * PARAMETERS:
+ * 			- msg : the tracked boxes of a difference frame
+ * 
+ * RETURN: --
+ */
+void Chroma_processing::regionsCb(const ros_visual_msgs::TrackRegionsConstPtr& msg)
+{
+	vector< Rect_<int> > boxes(msg->boxes.size());
+	for(int i = 0; i < msg->boxes.size(); ++i)
+	{
+		const ros_visual_msgs::Rectangle& rect = msg->boxes[i];
+		boxes[i] = Rect_<int>(rect.x, rect.y, rect.width, rect.height);
+	}
+	planner.setTracks(boxes, msg->header.stamp.toSec());
 }
 
 /**
@@ -182,23 +306,17 @@ bool Chroma_processing::nodeStateCallback(radio_services::InstructionWithAnswer:
 	}
 	else if(req.command == 1 && !running){
 		running = true;
+		frame_monitor.reset();
+		planner.reset();
 		if(playback_topics){
-			image_sub = it_.subscribe(image_topic, 10, &Chroma_processing::imageCb, this, image_transport::TransportHints("compressed"));
+			image_sub = it_.subscribe(image_topic, frame_policy.subscriberQueue(), &Chroma_processing::imageCb, this, image_transport::TransportHints("compressed"));
 			ROS_INFO("Started ros_visual/chroma!");
 		}
 		else{
-			image_sub = it_.subscribe(image_topic, 10, &Chroma_processing::imageCb, this);
+			image_sub = it_.subscribe(image_topic, frame_policy.subscriberQueue(), &Chroma_processing::imageCb, this);
 			ROS_INFO("Started ros_visual/chroma!");
 		}
 	}
 	res.answer = running;
 	return true;
 }
-
-int main(int argc, char** argv)
-{
-	ros::init(argc, argv, "chroma");
-	Chroma_processing ip;
-	ros::spin();
-	return 0;
-}
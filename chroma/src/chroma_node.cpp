@@ -0,0 +1,9 @@
+#include <chroma.hpp>
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "chroma");
+	Chroma_processing ip;
+	ros::spin();
+	return 0;
+}
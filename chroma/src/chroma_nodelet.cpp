@@ -0,0 +1,25 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include <chroma.hpp>
+
+namespace chroma
+{
+	/* Nodelet wrapper of Chroma_processing. Loaded in the same manager as the other
+	 * ros_visual nodelets, images are passed as shared pointers instead of
+	 * being serialized over TCPROS.
+	 */
+	class ChromaNodelet : public nodelet::Nodelet
+	{
+		private:
+		
+			virtual void onInit()
+			{
+				processing.reset(new Chroma_processing(getNodeHandle(), getPrivateNodeHandle()));
+			}
+			
+			boost::shared_ptr<Chroma_processing> processing;
+	};
+}
+
+PLUGINLIB_EXPORT_CLASS(chroma::ChromaNodelet, nodelet::Nodelet)
@@ -13,6 +13,10 @@
 #include <limits>
 #include <exception>
 #include <vision.hpp>
+#include <image_bridge.hpp>
+#include <frame_policy.hpp>
+#include <profile_diagnostics.hpp>
+#include <ros_visual_msgs/FrameTrace.h>
 #include "radio_services/InstructionWithAnswer.h"
 
 
@@ -26,7 +30,7 @@ class Depth_processing
 {
 	public:
 				
-		Depth_processing();
+		Depth_processing(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle local_nh = ros::NodeHandle("~"));
 		~Depth_processing();
 		
 		//depth callback
@@ -39,6 +43,12 @@ class Depth_processing
 		cv_bridge::CvImagePtr cv_ptr;
 		image_transport::ImageTransport it_;
 		image_transport::Subscriber depth_sub;
+		ros::Publisher diagnostics_pub;
+		ros::Publisher trace_pub;
+		FramePolicy frame_policy;
+		FrameMonitor frame_monitor;
+		Profiler profiler;
+		ProfileReporter profile_reporter;
 		image_transport::Publisher  depth_pub;
 		ros::ServiceServer service;
 			
@@ -50,6 +60,10 @@ class Depth_processing
 		
 		Mat ref_depth;
 		Mat dif_depth;
+		Mat cur_depth;
+		
+		sensor_msgs::ImagePtr depth_msg;
+		CopyStats copy_stats;
 		
 		vector< Rect_<int> > depth_rects;
 		
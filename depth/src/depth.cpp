@@ -1,11 +1,10 @@
 #include <depth.hpp>
 
 	
-Depth_processing::Depth_processing()
-: it_(nh_)
+Depth_processing::Depth_processing(ros::NodeHandle nh, ros::NodeHandle local_nh)
+: nh_(nh), it_(nh_)
 {
     //Getting the parameters specified by the launch file 
-    ros::NodeHandle local_nh("~");
     local_nh.param("depth_topic"		, depth_topic		, string("/camera/depth/image_raw"));
     local_nh.param("depth_out_image_topic"	, depth_out_image_topic , string("/depth_proc/image"));
     local_nh.param("project_path"		,path_			, string(""));
@@ -15,16 +14,28 @@ Depth_processing::Depth_processing()
     local_nh.param("min_depth"			, min_depth		, DEPTH_MIN);
     local_nh.param("run_on_start"        , running             , false);
     
+    //Backpressure of the depth subscription and its counters
+    frame_policy    = FramePolicy::fromParams(local_nh);
+    frame_monitor   = FrameMonitor("ros_visual/depth", frame_policy);
+    diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    trace_pub       = nh_.advertise<ros_visual_msgs::FrameTrace>("/ros_visual/trace", 10);
+    
+    //Stage latencies, published on the same topic
+    double profiling_period;
+    local_nh.param("profiling"           , profiler.enabled    , false);
+    local_nh.param("profiling_period"    , profiling_period    , 5.0);
+    profile_reporter = ProfileReporter("ros_visual/depth", profiling_period);
+    
     if(playback_topics && running)
     {
 	ROS_INFO_STREAM_NAMED("Depth_processing","Subscribing at compressed topics \n"); 
 			
-	depth_sub = it_.subscribe(depth_topic, 1, 
+	depth_sub = it_.subscribe(depth_topic, frame_policy.subscriberQueue(), 
 	   &Depth_processing::depthCb, this, image_transport::TransportHints("compressedDepth"));
     }
     else{
         if(running){
-            depth_sub = it_.subscribe(depth_topic, 1, &Depth_processing::depthCb, this);
+            depth_sub = it_.subscribe(depth_topic, frame_policy.subscriberQueue(), &Depth_processing::depthCb, this);
         }
     }
 	
@@ -53,16 +64,22 @@ Depth_processing::~Depth_processing()
  */
 void Depth_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
 {
-    Mat cur_depth;
+    ros::Time received = ros::Time::now();
     Mat temp_depth;
-    int morph_elem = 0;
-    int morph_size = 2;
-    int morph_operator = 0;
-    cv_bridge::CvImagePtr cv_ptr_depth;
+    cv_bridge::CvImageConstPtr cv_ptr_depth;
     
+    bool process = frame_monitor.accept(msg->header);
+    frame_monitor.publish(diagnostics_pub);
+    if(!process)
+        return;
+    
+    ScopedTimer frame_timer(&profiler, STAGE_FRAME);
+    ScopedTimer timer(&profiler, STAGE_DECODE);
     try
     {
-	    cv_ptr_depth = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::TYPE_32FC1);
+	    //Shares the message buffer, 16UC1 is used as it is and other encodings
+	    //are copied only if a conversion to 32FC1 is needed
+	    cv_ptr_depth = shareDepth(msg, copy_stats);
     }
     catch (cv_bridge::Exception& e)	
     {
@@ -70,9 +87,14 @@ void Depth_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
 	    return;
     }
     
-    cur_depth = (cv_ptr_depth->image);
-    //Converting depth values to 0-255
-    depthToGray(cur_depth, cur_depth, min_depth, max_depth);
+    //Depth preprocessing and filling of areas in the depth image that have no value
+    //because of sensor noise or surface reflectivity. The corrected depth is written
+    //straight into the outgoing message, the gray buffer is reused between frames
+    const Mat& in_depth = cv_ptr_depth->image;
+    Mat out_depth = prepareImage(depth_msg, msg->header, in_depth.rows, in_depth.cols, CV_32FC1, sensor_msgs::image_encodings::TYPE_32FC1);
+    timer.next(STAGE_DEPTH_FILTER);
+    cleanDepth(in_depth, cur_depth, out_depth, min_depth, max_depth);
+    timer.stop();
     
     if (dFrameCounter == -1)
     {
@@ -80,17 +102,6 @@ void Depth_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
 	    dFrameCounter++;
     }
     
-    //Depth preprocessing
-    Mat element = getStructuringElement( morph_elem, Size( 2*morph_size + 1, 2*morph_size+1 ), Point( morph_size, morph_size ) );
-    
-    Mat depth_dif;
-    morphologyEx(cur_depth, cur_depth, 3, element);
-    
-    //Filling areas in the depth image that have no value because
-    //of sensor noise or surface reflectivity
-    rectFill(cur_depth, 0.3, 2);
-    upVerticalFill(cur_depth, 0.3, true);
-    
 
     /* Frame difference
      * 
@@ -178,14 +189,29 @@ void Depth_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
     
     waitKey(1);
     
-    //Converting chroma values to meters
-    grayToDepth(cur_depth, cur_depth, max_depth);
-    
+    //Hop of the frame, fusion attaches it to the results. Published ahead
+    //of the depth image so it is already queued when fusion handles it
+    timer.next(STAGE_PUBLISH);
+    if(trace_pub.getNumSubscribers() > 0)
+    {
+        ros_visual_msgs::FrameTrace trace;
+        ros_visual_msgs::FrameHop hop;
+        hop.node      = "depth";
+        hop.received  = received;
+        hop.published = ros::Time::now();
+        trace.header  = msg->header;
+        trace.hops.push_back(hop);
+        trace_pub.publish(trace);
+    }
     
     //Publish corrected depth image
-    cv_ptr_depth->image = cur_depth;
-    depth_pub.publish(cv_ptr_depth->toImageMsg());
-	
+    depth_pub.publish(depth_msg);
+    timer.stop();
+    frame_timer.stop();
+    profile_reporter.publish(profiler, diagnostics_pub);
+    
+    copy_stats.endFrame();
+    ROS_DEBUG_THROTTLE(5, "Depth_processing: %lu bytes copied in the last frame", (unsigned long)copy_stats.last_frame_bytes);
 
 }
 
@@ -210,23 +236,16 @@ bool Depth_processing::nodeStateCallback(radio_services::InstructionWithAnswer::
     }
     else if(req.command == 1 && !running){
         running = true;
+        frame_monitor.reset();
         if(playback_topics){
-            depth_sub = it_.subscribe(depth_topic, 10, &Depth_processing::depthCb, this, image_transport::TransportHints("compressedDepth"));
+            depth_sub = it_.subscribe(depth_topic, frame_policy.subscriberQueue(), &Depth_processing::depthCb, this, image_transport::TransportHints("compressedDepth"));
             ROS_INFO("Started ros_visual/depth!");
         }
         else{
-            depth_sub = it_.subscribe(depth_topic, 10, &Depth_processing::depthCb, this);
+            depth_sub = it_.subscribe(depth_topic, frame_policy.subscriberQueue(), &Depth_processing::depthCb, this);
             ROS_INFO("Started ros_visual/depth!");
         }
     }
     res.answer = running;
     return true;
 }
-
-int main(int argc, char** argv)
-{
-	ros::init(argc, argv, "depth");
-	Depth_processing ip;
-	ros::spin();	
-	return 0;
-}
@@ -0,0 +1,9 @@
+#include <depth.hpp>
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "depth");
+	Depth_processing ip;
+	ros::spin();
+	return 0;
+}
@@ -0,0 +1,25 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include <depth.hpp>
+
+namespace depth
+{
+	/* Nodelet wrapper of Depth_processing. Loaded in the same manager as the other
+	 * ros_visual nodelets, images are passed as shared pointers instead of
+	 * being serialized over TCPROS.
+	 */
+	class DepthNodelet : public nodelet::Nodelet
+	{
+		private:
+		
+			virtual void onInit()
+			{
+				processing.reset(new Depth_processing(getNodeHandle(), getPrivateNodeHandle()));
+			}
+			
+			boost::shared_ptr<Depth_processing> processing;
+	};
+}
+
+PLUGINLIB_EXPORT_CLASS(depth::DepthNodelet, nodelet::Nodelet)
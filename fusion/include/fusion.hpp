@@ -16,13 +16,24 @@
 #include <message_filters/subscriber.h>
 #include <image_transport/subscriber_filter.h>
 #include <message_filters/sync_policies/approximate_time.h>
+#include <message_filters/synchronizer.h>
 #include <sensor_msgs/Image.h>
+#include <ros/callback_queue.h>
+#include <mutex>
+#include <deque>
 
 #include <utility.hpp>
 #include <vision.hpp>
+#include <image_bridge.hpp>
+#include <frame_policy.hpp>
+#include <profile_diagnostics.hpp>
 
 #include <ros_visual_msgs/FusionMsg.h>
 #include <ros_visual_msgs//Box.h>
+#include <ros_visual_msgs/FrameTrace.h>
+#include <ros_visual_msgs/MotionBoxes.h>
+#include <results.hpp>
+#include <session_writer.hpp>
 
 using namespace std;
 using namespace cv;
@@ -34,27 +45,81 @@ class Fusion_processing
 {
 	public:
 			
-		Fusion_processing();		  
+		Fusion_processing(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle local_nh = ros::NodeHandle("~"));
 		~Fusion_processing();
 				
 		void chromaCb(const sensor_msgs::ImageConstPtr& msg);
 		void depthCb(const sensor_msgs::ImageConstPtr& msg);
+		void syncCb(const sensor_msgs::ImageConstPtr& dif_msg, const sensor_msgs::ImageConstPtr& depth_msg);
+		void traceCb(const ros_visual_msgs::FrameTraceConstPtr& msg);
+		void boxesCb(const ros_visual_msgs::MotionBoxesConstPtr& msg);
 
-		void writeCSV(People& collection, string path, ros::Time time);
-		void publishResults(People& collection, ros::Time time);
+		void writeCSV(People& collection, ros::Time time);
+		void publishResults(People& collection, ros::Time time, ros::Time received);
 
 		
 		
 	private:
 	
+		typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image> SyncPolicy;
+		
+		//A difference frame waiting for its motion boxes
+		struct PendingFrame
+		{
+			sensor_msgs::ImageConstPtr dif;
+			cv_bridge::CvImageConstPtr depth; 	//paired in the synchronized mode
+			ros::Time received;
+		};
+		
+		bool decodeDepth(const sensor_msgs::ImageConstPtr& msg, cv_bridge::CvImageConstPtr& depth, CopyStats& stats);
+		void useDepth(const cv_bridge::CvImageConstPtr& depth);
+		void takeDepth();
+		void queueFrame(const sensor_msgs::ImageConstPtr& msg, const cv_bridge::CvImageConstPtr& depth);
+		void runPendingFrames();
+		void runFrame(const PendingFrame& pending, const vector< Rect_<int> >* boxes, Size frame);
+		void processFrame(const sensor_msgs::ImageConstPtr& msg, ros::Time received, const vector< Rect_<int> >* boxes, Size frame);
+		void findHop(const string& node, ros::Time stamp, vector<ros_visual_msgs::FrameHop>& hops);
+		bool findMotionBoxes(ros::Time stamp, vector< Rect_<int> >& boxes, Size& frame);
+	
 		ros::NodeHandle nh_;
 		ros::Publisher results_publisher;
+		ros::Publisher regions_pub;
 		image_transport::ImageTransport it_;
 		image_transport::Subscriber image_sub;
 		image_transport::Subscriber depth_sub;
-		ros::Time previous_time;
+		ros::Publisher diagnostics_pub;
+		ros::Subscriber trace_sub;
+		deque<ros_visual_msgs::FrameTrace> traces;
+		ros::Subscriber boxes_sub;
+		deque<ros_visual_msgs::MotionBoxes> motion_boxes;
+		deque<PendingFrame> pending_frames;
+		FramePolicy frame_policy;
+		FrameMonitor dif_monitor;
+		FrameMonitor depth_monitor;
+		Profiler profiler;
+		ProfileReporter profile_reporter;
+		
+		//Depth is received on its own queue and thread, the newest decoded
+		//frame waits in latest_depth until the chroma callback takes it
+		ros::NodeHandle depth_nh_;
+		ros::CallbackQueue depth_queue;
+		boost::shared_ptr<image_transport::ImageTransport> depth_it_;
+		boost::shared_ptr<ros::AsyncSpinner> depth_spinner;
+		mutex depth_mutex;
+		cv_bridge::CvImageConstPtr latest_depth;
+		CopyStats depth_copy_stats;
+		image_transport::SubscriberFilter dif_filter;
+		image_transport::SubscriberFilter depth_filter;
+		boost::shared_ptr< message_filters::Synchronizer<SyncPolicy> > sync;
+		FrameInterval frame_interval;
+		float time_interval = 0.0; 	//of the current frame
   	
+		cv_bridge::CvImageConstPtr cv_ptr_depth;
+		CopyStats copy_stats;
+		boost::shared_ptr<SessionWriter> session_writer;
+		
 		Mat depth_Mat;
+		DepthIntegral depth_integral;
 		Mat back_Mat;
 		vector<Mat> depth_storage;
 		vector< Rect_<int> > depth_rects;
@@ -65,10 +130,17 @@ class Fusion_processing
 		string image_dif_topic;
 		string depth_topic;
 		string results_topic;
+		string roi_topic;
+		string motion_boxes_topic;
         string csv_fields;
+		string log_format;
+		string depth_estimator_name;
+		string depth_std_name;
 		string camera_frame;
 		
 		People people;
+		DepthEstimator depth_estimator = DEPTH_KMEANS;
+		DepthDeviation depth_deviation = DEPTH_STD_MEAN_ABS;
 		
 		bool playback_topics;
 		bool display;
@@ -77,6 +149,11 @@ class Fusion_processing
 		bool has_image = false;
 		bool depth_available = false;
 		bool use_depth = false;
+		bool sync_depth = false;
+		bool motion_model = false;
+		int motion_scale = 1; 					//of chroma, above 1 the difference waits for its motion boxes
+		Size motion_frame; 						//frame size of the latest motion boxes
+		MotionParams motion_params;
 		
 		int Hfield 		  = 58;
 		int Vfield 		  = 45;
@@ -92,6 +169,12 @@ class Fusion_processing
 		int recR 		  = 2;
 		int counter = 0;
 		int max_rank = 0;
+		int sync_queue = 10;
+		int feature_threads = 4;
+		int csv_queue  = 256;
+		int csv_flush_bytes = 1 << 20;
+		unsigned long pairs = 0;
+		unsigned long unmatched_frames = 0; 	//dropped without their motion boxes
 		long curTime ;
 		float backFactor = 0.40;
 		
@@ -103,6 +186,11 @@ class Fusion_processing
 		double horThreshold  = 0.33;
 		double vertThreshold = 0.5;
 		double recThreshold  = 0.3;
+		double sync_slop 	 = 0.02; //in seconds
+		double motion_boxes_wait = 0.1; //in seconds
+		double pair_offset_sum = 0;
+		double pair_offset_max = 0;
+		double csv_flush_interval = 1.0; //in seconds
 		
 		
 	
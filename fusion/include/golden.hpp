@@ -0,0 +1,68 @@
+#ifndef GOLDEN_HPP
+#define GOLDEN_HPP
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <pipeline.hpp>
+
+using namespace std;
+
+/* Output of the pipeline for one frame, stored as text in a golden file so
+ * rewrites of the detection, tracking and depth filling can be checked
+ * against the output they had before
+ *
+ * 		tolerance <box> <rankings> <features> <depth mean> <depth filled>
+ * 		frame <number> <boxes> <depth hash> <depth filled> <depth mean>
+ * 		box <x> <y> <width> <height> <ranking> <Position fields...>
+ *
+ * The tolerance line is optional and comes first, it holds how far the
+ * pipeline may move from the recorded output (see GoldenTolerance).
+ */
+struct GoldenFrame
+{
+	long number 	  = 0;
+	uint64_t depth_hash = 0; 	//FNV-1a of the filled grayscale depth
+	long depth_filled = 0; 		//non zero pixels of the filled depth
+	double depth_mean = 0.0;
+	vector< Rect_<int> > boxes;
+	vector<float> rankings;
+	vector<Position> pos;
+};
+
+/* How far a frame may move from its golden output, all 0 for bit exact */
+struct GoldenTolerance
+{
+	int box 			= 0; 	//box edges, in pixels
+	float rankings 		= 0.0; 	//absolute
+	double features 	= 0.0; 	//Position features, relative (absolute below 1)
+	double depth_mean 	= 0.0; 	//mean grey level of the filled depth, absolute in grey levels
+	double depth_filled = 0.0; 	//non zero pixels of the filled depth, relative
+};
+
+/* Differences found by compareGolden */
+struct GoldenReport
+{
+	long frames 	  = 0;
+	long box_mismatch = 0; 	//frames whose boxes differ in number or place
+	long feature_mismatch = 0; 	//features off by more than the tolerance
+	long depth_mismatch = 0; 	//frames whose filled depth is not bit exact
+	int max_box_shift 		 = 0; 	//pixels
+	float max_ranking_error  = 0.0;
+	double max_feature_error = 0.0;
+	double max_depth_mean_error   = 0.0; 	//grey levels
+	double max_depth_filled_error = 0.0; 	//relative
+
+	bool passed() const { return box_mismatch == 0 && feature_mismatch == 0 && depth_mismatch == 0; }
+};
+
+void captureGolden(long number, Pipeline& pipeline, GoldenFrame& frame);
+void captureGolden(long number, const vector< Rect_<int> >& boxes, const vector<float>& rankings, const vector<Position>& pos, const Mat& depth_gray, GoldenFrame& frame);
+void writeGolden(ostream& out, const GoldenFrame& frame);
+bool readGolden(istream& in, GoldenFrame& frame);
+void writeGoldenTolerance(ostream& out, const GoldenTolerance& tolerance);
+bool readGoldenTolerance(istream& in, GoldenTolerance& tolerance);
+void compareGolden(const GoldenFrame& expected, const GoldenFrame& actual, const GoldenTolerance& tolerance, GoldenReport& report, ostream& log);
+
+#endif // GOLDEN_HPP
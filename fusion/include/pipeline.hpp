@@ -0,0 +1,153 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/image_encodings.h>
+#include <vector>
+#include <string>
+
+#include <vision.hpp>
+#include <preprocessing.hpp>
+#include <roi_planner.hpp>
+#include <image_bridge.hpp>
+#include <frame_policy.hpp>
+#include <profile_diagnostics.hpp>
+#include <results.hpp>
+
+#include <ros_visual_msgs/FusionMsg.h>
+
+using namespace std;
+using namespace cv;
+
+#define DEPTH_MAX 6000.0  /**< Default maximum distance. Only use this for initialization. */
+#define DEPTH_MIN 0.0  /**< Default minimum distance. Only use this for initialization. */
+
+/* One RGB frame travelling through the pipeline stages, the Mats are
+ * reused between frames */
+struct Frame
+{
+	std_msgs::Header header;
+	Mat image;
+	Mat processed;
+	Mat dif;
+	vector< Rect_<int> > blobs;
+	vector< Rect_<int> > regions; 	//processed regions when regions_only is set
+	bool regions_only = false;
+};
+
+struct PipelineConfig
+{
+	float gamma 			= 2.5;
+	double clahe_clip_limit = 1.5;
+	int clahe_tiles 		= 10;
+	float back_factor 		= 0.80;
+	float motion_threshold  = 255*0.33;
+	int motion_scale 		= 1; 	//pyramid level of the background, see MotionDetector
+	int blob_range 			= 15;
+	int max_rank 			= 30;
+	double min_depth 		= DEPTH_MIN;
+	double max_depth 		= DEPTH_MAX;
+	DepthEstimator depth_estimator = DEPTH_KMEANS;
+	DepthDeviation depth_deviation = DEPTH_STD_MEAN_ABS;
+	int feature_threads 	= 4;
+	bool motion_model 		= false; 	//track with the constant velocity model
+	MotionParams motion;
+	bool roi_mode 			= false; 	//preprocess and detect motion around the tracked boxes
+	RoiParams roi;
+};
+
+/* The chroma, depth and fusion processing as staged functions over one
+ * frame, with no transport in between. Each stage reads what the previous
+ * ones stored in the Frame.
+ */
+class Pipeline
+{
+	public:
+
+		Pipeline(const PipelineConfig& config = PipelineConfig());
+		~Pipeline();
+
+		void configure(const PipelineConfig& config);
+
+		//stages, in order
+		void preprocess(Frame& frame);
+		void detectMotion(Frame& frame);
+		void detect(Frame& frame);
+		void trackBlobs(Frame& frame);
+		void extractFeatures(Frame& frame);
+		bool results(Frame& frame, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg);
+
+		bool process(Frame& frame, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg);
+		void processDepth(const Mat& src);
+
+		const Mat& depth() const;
+		const Mat& depthGray() const;
+		People& tracked();
+		Profiler& profiler();
+
+	private:
+
+		PipelineConfig config;
+		ImagePreprocessor preprocessor;
+		MotionDetector motion;
+		RoiPlanner planner;
+		Mat processed; 	//kept between frames in ROI mode
+		Profiler stage_profiler;
+
+		People people;
+
+		Mat depth_Mat;
+		Mat depth_gray;
+		DepthIntegral depth_integral;
+		bool depth_available = false;
+
+		FrameInterval frame_interval;
+};
+
+/* ROS node running the Pipeline in a single thread, publishing only the
+ * results unless debug_images is set */
+class Pipeline_processing
+{
+	public:
+
+		Pipeline_processing(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle local_nh = ros::NodeHandle("~"));
+		~Pipeline_processing();
+
+		void imageCb(const sensor_msgs::ImageConstPtr& msg);
+		void depthCb(const sensor_msgs::ImageConstPtr& msg);
+
+	private:
+
+		ros::NodeHandle nh_;
+		image_transport::ImageTransport it_;
+		image_transport::Subscriber image_sub;
+		image_transport::Subscriber depth_sub;
+		image_transport::Publisher image_pub;
+		image_transport::Publisher image_pub_dif;
+		image_transport::Publisher depth_pub;
+		ros::Publisher results_publisher;
+		ros::Publisher diagnostics_pub;
+		FramePolicy frame_policy;
+		FrameMonitor image_monitor;
+		FrameMonitor depth_monitor;
+		ProfileReporter profile_reporter;
+
+		string image_topic;
+		string depth_topic;
+		string image_out_topic;
+		string image_out_dif_topic;
+		string depth_out_image_topic;
+		string results_topic;
+		string camera_frame;
+
+		bool playback_topics;
+		bool use_depth;
+		bool debug_images;
+
+		Pipeline pipeline;
+		Frame frame;
+		CopyStats copy_stats;
+};
+
+#endif // PIPELINE_HPP
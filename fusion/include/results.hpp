@@ -0,0 +1,35 @@
+#ifndef RESULTS_HPP
+#define RESULTS_HPP
+#include <ros/ros.h>
+#include <string>
+#include <vision.hpp>
+#include <ros_visual_msgs/FusionMsg.h>
+#include <ros_visual_msgs/Box.h>
+#include <ros_visual_msgs/TrackRegions.h>
+
+using namespace std;
+
+/* Interval between consecutive frames, the per frame features are divided
+ * by it. A stamp that repeats or goes backwards (looped bag, camera restart)
+ * would turn them into inf or NaN or flip their sign, so such a frame, like
+ * the first one, gets the last valid interval, or 1/fps before there is one.
+ */
+class FrameInterval
+{
+	public:
+
+		float next(ros::Time time, double fps);
+
+	private:
+
+		ros::Time previous;
+		float last = 0.0;
+};
+
+//Populates a results message with the tracked boxes and their features
+void fillFusionMsg(People& collection, ros::Time time, float time_interval, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg);
+
+//Populates the tracked boxes fed back to chroma
+void fillTrackRegions(const People& collection, const std_msgs::Header& header, ros_visual_msgs::TrackRegions& msg);
+
+#endif // RESULTS_HPP
@@ -0,0 +1,124 @@
+#ifndef SESSION_WRITER_HPP
+#define SESSION_WRITER_HPP
+#include <ros/ros.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdio.h>
+#include <stdint.h>
+#include <vision.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Binary session log (fusion.bin)
+ * 
+ * The file starts with a SessionLogHeader followed by the schema, one
+ * SessionLogField per column and then the column names as consecutive null
+ * terminated strings. The schema is padded so that the records start at
+ * header_size, a multiple of 8, and the records can be memory mapped as an
+ * array of SessionLogRecord. The columns are the ones of fusion.csv, the
+ * names come from the csv_fields parameter.
+ * 
+ * A record with id < 0 marks a frame (or a low ranked box) that only has a
+ * timestamp, like the timestamp-only lines of the csv.
+ */
+#define SESSION_LOG_MAGIC   "RVLOG\0\0\0"
+#define SESSION_LOG_VERSION 1
+#define SESSION_LOG_VALUES  13
+
+struct SessionLogHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t field_count;
+	uint32_t record_size;
+	uint32_t header_size;
+};
+
+/* Column types: 't' timestamp (uint32 sec + uint32 nsec), 'i' int32, 'f' float32 */
+struct SessionLogField
+{
+	uint32_t type;
+	uint32_t offset;
+};
+
+struct SessionLogRecord
+{
+	uint32_t sec;
+	uint32_t nsec;
+	int32_t id;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	float values[SESSION_LOG_VALUES];
+};
+
+//Column layout of SessionLogRecord, in csv order
+vector<SessionLogField> sessionLogLayout();
+
+/* Appends the per frame results to the session log from a background
+ * thread. The callback only copies the tracked boxes into a slot of a bounded
+ * single producer / single consumer ring, the writer thread formats the
+ * records into a large buffer that is written out when it exceeds
+ * flush_bytes or flush_interval seconds have passed. The slots keep their
+ * storage, so no allocation happens on the callback once they are warm.
+ * If the ring is full the record is dropped instead of blocking the caller.
+ */
+class SessionWriter
+{
+	public:
+
+		enum Format { CSV, BINARY };
+
+		SessionWriter(const string& path, Format format = CSV, const vector<string>& fields = vector<string>(),
+					  size_t capacity = 256, size_t flush_bytes = 1 << 20, double flush_interval = 1.0);
+		~SessionWriter();
+
+		bool push(const People& collection, ros::Time time, float time_interval);
+		unsigned long dropped() const;
+
+	private:
+
+		struct Row
+		{
+			int id;
+			Rect_<int> box;
+			Position pos;
+			float rank;
+		};
+
+		struct Record
+		{
+			ros::Time time;
+			float time_interval;
+			vector<Row> rows;
+		};
+
+		void run();
+		void format(const Record& record);
+		void formatCSV(const Record& record);
+		void formatBinary(const Record& record);
+		void writeHeader(const vector<string>& fields);
+		void flush();
+
+		vector<Record> ring;
+		atomic<size_t> head;
+		atomic<size_t> tail;
+		atomic<bool> running;
+		atomic<unsigned long> dropped_records;
+
+		Format log_format;
+		FILE* file;
+		ostringstream buffer;
+		string binary;
+		size_t flush_bytes;
+		double flush_interval;
+
+		thread worker;
+};
+
+#endif // SESSION_WRITER_HPP
@@ -1,74 +1,255 @@
 #include <fusion.hpp>
 
 
-Fusion_processing::Fusion_processing()
-: it_(nh_)
+Fusion_processing::Fusion_processing(ros::NodeHandle nh, ros::NodeHandle local_nh)
+: nh_(nh), it_(nh_)
 {
 	 //Getting the parameters specified by the launch file 
-	ros::NodeHandle local_nh("~");
 	local_nh.param("camera_frame" 	 , camera_frame		, string("camera_link"));
 	local_nh.param("results_topic"	 , results_topic	, string("results"));
 	local_nh.param("image_topic"	 , image_topic		, string("/chroma_proc/image"));
 	local_nh.param("image_dif_topic" , image_dif_topic  , string("/chroma_proc/image_dif"));
 	local_nh.param("depth_topic"     , depth_topic		, string("/depth_proc/image"));
+	local_nh.param("roi_topic"		 , roi_topic		, string("/ros_visual/track_regions"));
+	local_nh.param("motion_boxes_topic", motion_boxes_topic, string("/ros_visual/motion_boxes"));
+	local_nh.param("motion_boxes_wait", motion_boxes_wait, 0.1);
+	local_nh.param("motion_scale"	 , motion_scale 	, 1);
 	local_nh.param("project_path"	 , path_ 			, string(""));
 	local_nh.param("csv_fields"		 , csv_fields 		, string(""));
 	local_nh.param("playback_topics" , playback_topics  , false);
 	local_nh.param("create_directory", create_directory , false);
 	local_nh.param("write_csv"		 , write_csv 		, false);
+	local_nh.param("log_format"		 , log_format 		, string("csv"));
 	local_nh.param("display"		 , display 			, false);
 	local_nh.param("max_depth"		 , max_depth 		, DEPTH_MAX);
 	local_nh.param("min_depth"		 , min_depth 		, DEPTH_MIN);
 	local_nh.param("fps"			 , max_rank 		, 30);
 	local_nh.param("use_depth"		 , use_depth 		, false);
+	local_nh.param("depth_estimator" , depth_estimator_name, string("kmeans"));
+	local_nh.param("depth_std"		 , depth_std_name 	, string("mean_abs"));
+	local_nh.param("feature_threads" , feature_threads  , 4);
+	local_nh.param("motion_model"	 , motion_model 	, false);
+	local_nh.param("motion_process_noise"	 , motion_params.process_noise 	  , 2.0f);
+	local_nh.param("motion_measurement_noise", motion_params.measurement_noise, 8.0f);
+	local_nh.param("motion_size_noise"		 , motion_params.size_noise 	  , 4.0f);
+	local_nh.param("motion_gate"			 , motion_params.gate 			  , 3.0f);
+	depth_estimator = (depth_estimator_name == "histogram") ? DEPTH_HISTOGRAM : DEPTH_KMEANS;
+	depth_deviation = (depth_std_name == "valid_rms") ? DEPTH_STD_VALID_RMS : DEPTH_STD_MEAN_ABS;
 	
-	if(use_depth){
-		if(playback_topics)
+	local_nh.param("sync_depth"		 , sync_depth 		, false);
+	local_nh.param("sync_slop"		 , sync_slop 		, 0.02);
+	local_nh.param("sync_queue"		 , sync_queue 		, 10);
+	local_nh.param("csv_queue"		 , csv_queue 		, 256);
+	local_nh.param("csv_flush_bytes" , csv_flush_bytes  , 1 << 20);
+	local_nh.param("csv_flush_interval", csv_flush_interval, 1.0);
+	
+	//Backpressure of the image subscriptions and their counters
+	frame_policy 	= FramePolicy::fromParams(local_nh);
+	dif_monitor 	= FrameMonitor("ros_visual/fusion/image_dif", frame_policy);
+	depth_monitor 	= FrameMonitor("ros_visual/fusion/depth", frame_policy);
+	diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	uint32_t queue 	= frame_policy.subscriberQueue();
+	
+	//Stage latencies, published on the same topic
+	double profiling_period;
+	local_nh.param("profiling"		 , profiler.enabled , false);
+	local_nh.param("profiling_period", profiling_period , 5.0);
+	profile_reporter = ProfileReporter("ros_visual/fusion", profiling_period);
+	
+	image_transport::TransportHints depth_hints(playback_topics ? "compressed" : "raw");
+	if(playback_topics)
+		ROS_INFO_STREAM_NAMED("Fusion_processing","Subscribing at compressed topics \n"); 
+	
+	if(use_depth && sync_depth)
+	{
+		//Pair difference and depth frames by stamp. With raw transport only the
+		//matched depth frames are converted to 32FC1 (in syncCb), with the
+		//compressed transport of playback_topics image_transport decompresses
+		//every depth frame before the synchronizer sees it
+		dif_filter.subscribe(it_, image_dif_topic, queue);
+		depth_filter.subscribe(it_, depth_topic, queue, depth_hints);
+		SyncPolicy policy(sync_queue);
+		policy.setMaxIntervalDuration(ros::Duration(sync_slop));
+		sync = boost::make_shared< message_filters::Synchronizer<SyncPolicy> >(policy, dif_filter, depth_filter);
+		sync->registerCallback(boost::bind(&Fusion_processing::syncCb, this, _1, _2));
+	}
+	else
+	{
+		if(use_depth)
 		{
-			ROS_INFO_STREAM_NAMED("Fusion_processing","Subscribing at compressed topics \n"); 
-			depth_sub = it_.subscribe(depth_topic, 1, &Fusion_processing::depthCb, this, image_transport::TransportHints("compressed"));
-	    } 
-	    else
-	    {
-			depth_sub = it_.subscribe(depth_topic, 1, &Fusion_processing::depthCb, this);
+			//Depth decoding overlaps with the chroma processing
+			depth_nh_ = nh_;
+			depth_nh_.setCallbackQueue(&depth_queue);
+			depth_it_ = boost::make_shared<image_transport::ImageTransport>(depth_nh_);
+			depth_sub = depth_it_->subscribe(depth_topic, queue, &Fusion_processing::depthCb, this, depth_hints);
+			depth_spinner = boost::make_shared<ros::AsyncSpinner>(1, &depth_queue);
+			depth_spinner->start();
 		}
+		image_sub = it_.subscribe(image_dif_topic, queue, &Fusion_processing::chromaCb, this);
 	}
-	
-    image_sub = it_.subscribe(image_dif_topic, 1, &Fusion_processing::chromaCb, this);
     
     
     results_publisher = local_nh.advertise<ros_visual_msgs::FusionMsg>(results_topic, 1);
+    
+    //Tracked boxes of every frame, for the region of interest mode of chroma
+    regions_pub = nh_.advertise<ros_visual_msgs::TrackRegions>(roi_topic, 1);
+    
+    //Hops of the chroma and depth frames, attached to the results
+    trace_sub = nh_.subscribe("/ros_visual/trace", 64, &Fusion_processing::traceCb, this);
+    
+    //Blobs refined at full resolution by chroma, only published in its pyramid
+    //mode, the difference frames wait for them
+    boxes_sub = nh_.subscribe(motion_boxes_topic, 64, &Fusion_processing::boxesCb, this);
+	
+	SessionWriter::Format format = (log_format == "binary") ? SessionWriter::BINARY : SessionWriter::CSV;
+	string temp;
+	vector<string> fields;
+	stringstream stream(csv_fields);
+	while(stream >> temp)
+	{
+		replace(temp.begin(), temp.end(), ',', ' ');
+		fields.push_back(temp);
+	}
 	
 	if(create_directory)
     {
-        string temp;
-        vector<string> fields;
-        stringstream stream(csv_fields);
-        while(stream >> temp)
-        {
-			replace(temp.begin(), temp.end(), ',', ' ');
-            fields.push_back(temp);
-        }
         Utility u;
-		session_path = u.create_directory(path_, write_csv, fields, false);
+		session_path = u.create_directory(path_, write_csv && format == SessionWriter::CSV, fields, false);
     }
+    
+    if(write_csv)
+    {
+		string log_path = session_path + (format == SessionWriter::BINARY ? "/fusion.bin" : "/fusion.csv");
+		session_writer = boost::make_shared<SessionWriter>(log_path, format, fields, csv_queue, csv_flush_bytes, csv_flush_interval);
+	}
 }
 
 Fusion_processing::~Fusion_processing()
 {
+	//No depth callback may run while the members are destroyed
+	if(depth_spinner)
+		depth_spinner->stop();
+	depth_sub.shutdown();
+	
 	//destroy GUI windows
 	destroyAllWindows();
 	
 }
 
 void Fusion_processing::chromaCb(const sensor_msgs::ImageConstPtr& msg)
+{
+	bool process = dif_monitor.accept(msg->header);
+	dif_monitor.publish(diagnostics_pub);
+	if(process)
+		queueFrame(msg, cv_bridge::CvImageConstPtr());
+}
+
+/* Runs a difference frame. In the pyramid mode of chroma the frame first
+ * waits for the blobs chroma refined for its stamp, at most
+ * motion_boxes_wait seconds. The mode is motion_scale until motion boxes
+ * arrive, then a difference smaller than their frame is a pyramid one and
+ * a difference of the same size is a full resolution one, so a chroma
+ * restarted with another motion_scale is followed
+ * 
+ * PARAMETERS:
+ *	    - msg  : the difference image
+ *	    - depth: the depth frame paired with it in the synchronized mode, or null
+ * 
+ * RETURN --
+ */
+void Fusion_processing::queueFrame(const sensor_msgs::ImageConstPtr& msg, const cv_bridge::CvImageConstPtr& depth)
+{
+	PendingFrame pending;
+	pending.dif 	 = msg;
+	pending.depth 	 = depth;
+	pending.received = ros::Time::now();
+	bool pyramid = (motion_frame.area() > 0) ? Size(msg->width, msg->height) != motion_frame : motion_scale > 1;
+	if(!pyramid)
+	{
+		//The waiting frames are pyramid ones of a chroma since restarted
+		unmatched_frames += pending_frames.size();
+		pending_frames.clear();
+		runFrame(pending, NULL, Size());
+		return;
+	}
+	pending_frames.push_back(pending);
+	if(pending_frames.size() > 64)
+	{
+		pending_frames.pop_front();
+		++unmatched_frames;
+	}
+	runPendingFrames();
+}
+
+/* Runs the waiting difference frames whose motion boxes arrived, in order.
+ * A frame is dropped once its wait is over or once chroma published the
+ * boxes of a later frame, its own were lost. Tracking its coarse blobs
+ * instead would mix difference and frame coordinates.
+ * 
+ * RETURN --
+ */
+void Fusion_processing::runPendingFrames()
+{
+	ros::Time now = ros::Time::now();
+	vector< Rect_<int> > boxes;
+	Size frame;
+	while(!pending_frames.empty())
+	{
+		PendingFrame pending = pending_frames.front();
+		ros::Time stamp 	 = pending.dif->header.stamp;
+		if(findMotionBoxes(stamp, boxes, frame))
+		{
+			pending_frames.pop_front();
+			runFrame(pending, &boxes, frame);
+			continue;
+		}
+		bool lost = !motion_boxes.empty() && motion_boxes.back().header.stamp > stamp;
+		if(!lost && (now - pending.received).toSec() < motion_boxes_wait)
+			break;
+		pending_frames.pop_front();
+		++unmatched_frames;
+		ROS_WARN_THROTTLE(5, "Fusion_processing: %lu difference frames dropped without their motion boxes", unmatched_frames);
+	}
+}
+
+/* Runs a difference frame with its paired depth frame, if any
+ * 
+ * PARAMETERS:
+ *	    - pending: the frame
+ *	    - boxes  : blobs refined by chroma in frame coordinates, null to detect them here
+ *	    - frame  : size of the frame the refined blobs are in
+ * 
+ * RETURN --
+ */
+void Fusion_processing::runFrame(const PendingFrame& pending, const vector< Rect_<int> >* boxes, Size frame)
+{
+	if(pending.depth)
+		useDepth(pending.depth);
+	processFrame(pending.dif, pending.received, boxes, frame);
+}
+
+/* Detection, tracking, features and results of one difference frame
+ * 
+ * PARAMETERS:
+ *	    - msg	  : the difference image
+ *	    - received: when the frame was received by this node
+ *	    - boxes	  : blobs refined by chroma in frame coordinates, null to
+ *	    			detect them on the difference
+ *	    - frame	  : size of the frame the refined blobs are in
+ * 
+ * RETURN --
+ */
+void Fusion_processing::processFrame(const sensor_msgs::ImageConstPtr& msg, ros::Time received, const vector< Rect_<int> >* boxes, Size frame)
 {
 	Mat fusion;
 	vector< Rect_<int> > fusion_rects;
-	cv_bridge::CvImagePtr cv_ptr_dif;
+	cv_bridge::CvImageConstPtr cv_ptr_dif;
+	ScopedTimer frame_timer(&profiler, STAGE_FRAME);
+	ScopedTimer timer(&profiler, STAGE_DECODE);
 	try
 	{
-		cv_ptr_dif 	 = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::MONO8);
+		//The difference image is only read, share the message buffer
+		cv_ptr_dif 	 = shareImage(msg, sensor_msgs::image_encodings::MONO8, copy_stats);
 	}
 	catch (cv_bridge::Exception& e)
 	{
@@ -77,61 +258,43 @@ void Fusion_processing::chromaCb(const sensor_msgs::ImageConstPtr& msg)
 	}
 	
 	fusion 	 = (cv_ptr_dif->image);
-	int height 	 = (msg->height);
-	int width 	 = (msg->width);
 	
-	//Detect moving blobs
-	detectBlobs(fusion, fusion_rects, 15, 1, false);
+	//In the pyramid mode of chroma the difference is smaller than the frame
+	//and the blobs come refined at full resolution from chroma
+	timer.next(STAGE_BLOBS);
+	if(boxes)
+		fusion_rects = *boxes;
+	else
+	{
+		frame = Size(msg->width, msg->height);
+		detectBlobs(fusion, fusion_rects, 15, 1, false);
+	}
+	int height 	 = frame.height;
+	int width 	 = frame.width;
 	
 	//Track blobs
-	track(fusion_rects, people, width, height, 3, 5*max_rank);
+	timer.next(STAGE_TRACK);
+	track(fusion_rects, people, width, height, 3, 5*max_rank, motion_model ? &motion_params : NULL);
+	timer.stop();
+	
+	//Fed back to chroma even when empty, so it knows the tracker is alive
+	if(regions_pub.getNumSubscribers() > 0)
+	{
+		ros_visual_msgs::TrackRegions regions;
+		fillTrackRegions(people, msg->header, regions);
+		regions_pub.publish(regions);
+	}
 		
 	//Calculate depth, position and features of tracked boxes
+	takeDepth();
 	if(depth_available)
 	{
-		for(int i = 0; i < people.tracked_boxes.size(); ++i)
-		{
-			Mat depth_rect = depth_Mat(people.tracked_boxes[i]);
-			try
-			{
-				//Calculating depth 
-				float depth = calculateDepth(depth_rect, people.tracked_pos[i]);
-				
-				//Calculating z_diff feature
-				people.tracked_pos[i].z_diff = depth - people.tracked_pos[i].z;
-				
-				if(depth != 0)
-					people.tracked_pos[i].z = depth;
-				
-				//Calculating Std of depth feature
-				absdiff(depth_rect, people.tracked_pos[i].z, depth_rect);
-				people.tracked_pos[i].depth_std = sum(depth_rect)[0]/(depth_rect.rows*depth_rect.cols); 
-				
-				
-				//Visualize depth mat
-				//~ Mat res;
-				//~ depth = calculateDepth(depth_rect);
-				//~ depthToGray(depth_rect, res, 0, max_depth);
-				//~ imshow("depth", res);
-				//~ moveWindow("depth", 645, 0);
-			}
-			catch(exception& e)
-			{
-				printf("%s %s", "Calculate depth failed: ", e.what());
-			}
-			
-			try
-			{
-				//Calculate real world position, height, distance moved
-				calculatePosition(people.tracked_boxes[i], people.tracked_pos[i]);
-			}
-			catch(exception& e)
-			{
-				printf("%s %s", "Calculate position failed: ", e.what());
-			}
-		}
-		
-		
+		ScopedTimer features_timer(&profiler, STAGE_FEATURES);
+		//Integral images are built once per depth frame, on first use and only
+		//for the valid_rms depth_std that reads them
+		if(depth_deviation == DEPTH_STD_VALID_RMS && depth_integral.empty())
+			depth_integral.compute(depth_Mat);
+		calculateFeatures(people, depth_Mat, depth_integral, depth_estimator, depth_deviation, feature_threads, &profiler);
 	}
 	
 	
@@ -149,20 +312,22 @@ void Fusion_processing::chromaCb(const sensor_msgs::ImageConstPtr& msg)
 			float* cur = depth_rect.ptr<float>(i);
 			for(int j = 0; j < depth_rect.cols; j++)
 			{   
-				if(abs(cur[j] - people.tracked_pos[index].z) > 300)
+				if(abs(cur[j] - people.pos(index).z) > 300)
 					cur[j] = 0;
 			}   
 		}
 		depthToGray(depth_rect, depth_rect, min_depth, max_depth);
 		
-		depth_rect.copyTo(depth_filtered(people.tracked_boxes[index]));
+		depth_rect.copyTo(depth_filtered(people.box(index)));
 		
 		for(Rect rect: fusion_rects)
 			rectangle(fusion, rect, 255, 1);
 		*/
-		for(int i = 0; i < people.tracked_boxes.size(); ++i)
+		//Draw on a copy, the image shares the message buffer
+		fusion = fusion.clone();
+		for(int i = 0; i < people.size(); ++i)
 		{
-			rectangle(fusion, people.tracked_boxes[i], 255, 1);
+			rectangle(fusion, people.box(i), 255, 1);
 		}
 		imshow("fusion", fusion);
 		moveWindow("fusion", 0, 0);
@@ -171,155 +336,258 @@ void Fusion_processing::chromaCb(const sensor_msgs::ImageConstPtr& msg)
 	}
 	
 	
-	ros::Time time = ros::Time::now();
+	//The results carry the camera stamp of the frame they were computed from
+	ros::Time time = msg->header.stamp.isZero() ? received : msg->header.stamp;
+	time_interval  = frame_interval.next(time, max_rank);
+	timer.next(STAGE_PUBLISH);
 	//Write csv file
 	if(write_csv)
-		writeCSV(people, session_path, time);
+		writeCSV(people, time);
 
 	//Publish results
-	publishResults(people, time);
-	previous_time = time;
+	publishResults(people, time, received);
+	timer.stop();
+	frame_timer.stop();
+	profile_reporter.publish(profiler, diagnostics_pub);
+	
+	copy_stats.endFrame();
+	ROS_DEBUG_THROTTLE(5, "Fusion_processing: %lu bytes copied in the last frame", (unsigned long)copy_stats.last_frame_bytes);
 }
 
 void Fusion_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
 {
-	cv_bridge::CvImagePtr cv_ptr_depth;
+	//Runs on the depth thread, only the slot is shared with the chroma callback
+	cv_bridge::CvImageConstPtr depth;
+	bool process = depth_monitor.accept(msg->header);
+	depth_monitor.publish(diagnostics_pub);
+	if(!process)
+		return;
+	if(!decodeDepth(msg, depth, depth_copy_stats))
+		return;
+	depth_copy_stats.endFrame();
+	ROS_DEBUG_THROTTLE(5, "Fusion_processing: %lu bytes copied in the last depth frame", (unsigned long)depth_copy_stats.last_frame_bytes);
+	
+	lock_guard<mutex> lock(depth_mutex);
+	latest_depth = depth;
+}
+
+/* Callback of the synchronized mode, receives a difference frame together
+ * with the depth frame closest to it in time (within sync_slop)
+ * 
+ * PARAMETERS:
+ *	    - dif_msg  : the difference image
+ *	    - depth_msg: the matched depth image
+ * 
+ * RETURN --
+ */
+void Fusion_processing::syncCb(const sensor_msgs::ImageConstPtr& dif_msg, const sensor_msgs::ImageConstPtr& depth_msg)
+{
+	bool process = dif_monitor.accept(dif_msg->header);
+	dif_monitor.publish(diagnostics_pub);
+	if(!process)
+		return;
 	
+	//Stamp offset of the pair and delay between the newest stamp and its processing
+	double offset  = fabs((dif_msg->header.stamp - depth_msg->header.stamp).toSec());
+	ros::Time last = max(dif_msg->header.stamp, depth_msg->header.stamp);
+	double latency = (ros::Time::now() - last).toSec();
+	
+	++pairs;
+	pair_offset_sum += offset;
+	pair_offset_max  = max(pair_offset_max, offset);
+	ROS_DEBUG_THROTTLE(5, "Fusion_processing: %lu pairs, stamp offset %.1f ms (mean %.1f ms, max %.1f ms), pairing latency %.1f ms",
+		pairs, offset*1000, pair_offset_sum/pairs*1000, pair_offset_max*1000, latency*1000);
+	
+	cv_bridge::CvImageConstPtr depth;
+	if(!decodeDepth(depth_msg, depth, copy_stats))
+		return;
+	queueFrame(dif_msg, depth);
+}
+
+/* Wraps a depth frame in a Mat, sharing the message buffer when possible
+ * 
+ * PARAMETERS:
+ *	    - msg	: the depth image
+ *	    - depth	: the wrapped image, keeps the message alive
+ *	    - stats	: copy statistics of the calling thread
+ * 
+ * RETURN:
+ *	    - false if the image could not be converted
+ */
+bool Fusion_processing::decodeDepth(const sensor_msgs::ImageConstPtr& msg, cv_bridge::CvImageConstPtr& depth, CopyStats& stats)
+{
 	try
 	{
-		cv_ptr_depth    = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::TYPE_32FC1);
-		
+		depth = shareImage(msg, sensor_msgs::image_encodings::TYPE_32FC1, stats);
 	}
 	catch (cv_bridge::Exception& e)
 	{
 	  ROS_ERROR("cv_bridge exception: %s", e.what());
-	  return;
+	  return false;
 	}
+	return true;
+}
+
+/* Makes a decoded depth frame the one used by the features, its integral
+ * images are rebuilt on first use
+ * 
+ * PARAMETERS:
+ *	    - depth: the decoded depth image
+ * 
+ * RETURN --
+ */
+void Fusion_processing::useDepth(const cv_bridge::CvImageConstPtr& depth)
+{
+	//Keep the shared image alive as long as depth_Mat points to its buffer
+	cv_ptr_depth 	= depth;
 	depth_available = true;
 	depth_Mat 		= (cv_ptr_depth->image);
+	depth_integral.clear();
 }
 
+/* Takes the newest frame of the depth thread, if any arrived since the
+ * last call. The two threads only exchange the pointer under the lock, the
+ * frame in use stays valid while the depth thread decodes the next one.
+ * 
+ * RETURN --
+ */
+void Fusion_processing::takeDepth()
+{
+	cv_bridge::CvImageConstPtr depth;
+	{
+		lock_guard<mutex> lock(depth_mutex);
+		depth.swap(latest_depth);
+	}
+	if(depth)
+		useDepth(depth);
+}
 
-
-/* Function that writes creates a csv file and appends values to it
+/* Hands the results of a frame to the background session writer, the file
+ * itself is written outside of the callback
  * 
  * PARAMETERS:
  *	    - collection: object that contains the bounded boxes detected
- *	    - path		: the root path of the csv file
  *	    - time		: ROS object that has the timestamp the frame was created
  * 
  * 
  * RETURN --
  */
-void Fusion_processing::writeCSV(People& collection, string path, ros::Time time)
+void Fusion_processing::writeCSV(People& collection, ros::Time time)
 {		
-	ofstream storage(path + "/fusion.csv" ,ios::out | ios::app );
-	if(!collection.tracked_boxes.empty())
-	{
-		float time_interval  = (time - previous_time).toSec();
-		for(int i = 0; i < collection.tracked_boxes.size(); ++i) 
-		{
-			float rank = collection.tracked_rankings[i];
-			if(rank > 4)
-			{
-				Rect box = collection.tracked_boxes[i];
-				Position pos = collection.tracked_pos[i];
-				storage
-					<<time<<"\t"
-					<<i<<"\t"
-					<<box.x<<"\t"
-					<<box.y<<"\t"
-					<<box.width<<"\t"
-					<<box.height<<"\t"
-					<<pos.ratio<<"\t"
-					<<pos.ratio_diff/time_interval<<"\t"
-					<<pos.distance/time_interval<<"\t"
-					<<pos.distance_diff/time_interval<<"\t"
-					<<pos.x_diff/time_interval<<"\t"
-					<<pos.x_delta/time_interval<<"\t"
-					<<pos.y_diff/time_interval<<"\t"
-					<<pos.y_delta/time_interval<<"\t"
-					<<pos.y_norm<<"\t"
-					<<pos.y_norm_diff/time_interval<<"\t"
-					<<pos.z_diff/time_interval<<"\t"
-					<<abs(pos.z_diff)/time_interval<<"\t"
-					<<pos.depth_std<<
-				endl;
-			}
-			else
-			{
-				storage<<time<<endl;
-			}
-		}
-	}
-	else
-	{
-		storage<<time<<endl;
-	}
-	storage.close();
+	if(session_writer && !session_writer->push(collection, time, time_interval))
+		ROS_WARN_THROTTLE(5, "Fusion_processing: session log queue full, %lu records dropped", session_writer->dropped());
 }
 
 /* Creates a ROS message, populates it with the bounded boxes detected and their
- * metadata and publishes it  
+ * metadata and publishes it. The hops of the chroma and depth frames that were
+ * used and the one of this node are attached to it.
  * 
  * PARAMETERS:
  *	    - collection: object that contains the bounded boxes detected
- *	    - time		: ROS object that has the timestamp the frame was created
+ *	    - time		: camera stamp of the frame
+ *	    - received	: when the frame was received by this node
  * 
  * 
  * RETURN --
  */
-void Fusion_processing::publishResults(People& collection, ros::Time time){
-	if (!collection.tracked_boxes.empty())
+void Fusion_processing::publishResults(People& collection, ros::Time time, ros::Time received){
+	if (!collection.empty())
 	{
 		ros_visual_msgs::FusionMsg fmsg;
-
-		fmsg.header.stamp = time;
-		fmsg.header.frame_id = camera_frame;
-		float time_interval  = (time - previous_time).toSec();
-		for(int i = 0; i < collection.tracked_boxes.size() ; ++i) 
-		{
-			
-			Rect box = collection.tracked_boxes[i];
-			Position pos = collection.tracked_pos[i];
-			
-			ros_visual_msgs::Box box_;
-			
-			box_.id = i;
-			box_.rect.x = box.x;
-			box_.rect.y = box.y;
-			box_.rect.width = box.width;
-			box_.rect.height = box.height;
-			box_.pos.ratio = pos.ratio;
-			box_.pos.ratio_diff = pos.ratio_diff;
-			box_.pos.distance = pos.distance;
-			box_.pos.distance_diff = pos.distance_diff;
-			box_.pos.x_diff = pos.x_diff/time_interval;
-			box_.pos.x_delta = pos.x_delta/time_interval;
-			box_.pos.y_diff = pos.y_diff/time_interval;
-			box_.pos.y_delta = pos.y_delta/time_interval;
-			box_.pos.y_norm = pos.y_norm;
-			box_.pos.y_norm_diff = pos.y_norm_diff/time_interval;
-			box_.pos.z_diff = pos.z_diff;
-			box_.pos.z_diff_norm = pos.z_diff_norm;
-			box_.pos.depth_std = pos.depth_std;
-			
-			
-			fmsg.boxes.push_back(box_);
-		}
+		fillFusionMsg(collection, time, time_interval, camera_frame, fmsg);
+		
+		findHop("chroma", time, fmsg.hops);
+		if(depth_available)
+			findHop("depth", cv_ptr_depth->header.stamp, fmsg.hops);
+		ros_visual_msgs::FrameHop hop;
+		hop.node 	  = "fusion";
+		hop.received  = received;
+		hop.published = ros::Time::now();
+		fmsg.hops.push_back(hop);
+		
 		results_publisher.publish(fmsg);
 	}
 }
 
-		
-int main(int argc, char** argv)
+/* Keeps the latest hops published by chroma and depth
+ * 
+ * PARAMETERS:
+ *	    - msg: trace of one frame
+ * 
+ * RETURN --
+ */
+void Fusion_processing::traceCb(const ros_visual_msgs::FrameTraceConstPtr& msg)
 {
-  ros::init(argc, argv, "fusion");
-  Fusion_processing fp;
-  ros::spin();
-  return 0;
+	traces.push_back(*msg);
+	if(traces.size() > 64)
+		traces.pop_front();
 }
 
+/* Appends the hops of a node for the frame with the given camera stamp
+ * 
+ * PARAMETERS:
+ *	    - node : name of the node
+ *	    - stamp: camera stamp of the frame
+ *	    - hops : the hops found are appended here
+ * 
+ * RETURN --
+ */
+void Fusion_processing::findHop(const string& node, ros::Time stamp, vector<ros_visual_msgs::FrameHop>& hops)
+{
+	for(int i = traces.size() - 1; i >= 0; --i)
+	{
+		if(traces[i].header.stamp != stamp)
+			continue;
+		for(int k = 0; k < traces[i].hops.size(); ++k)
+			if(traces[i].hops[k].node == node)
+			{
+				hops.push_back(traces[i].hops[k]);
+				return;
+			}
+	}
+}
 
-		
-	
+/* Keeps the latest refined blobs published by chroma and runs the
+ * difference frames that were waiting for them
+ * 
+ * PARAMETERS:
+ *	    - msg: the blobs of one frame
+ * 
+ * RETURN --
+ */
+void Fusion_processing::boxesCb(const ros_visual_msgs::MotionBoxesConstPtr& msg)
+{
+	motion_frame = Size(msg->width, msg->height);
+	motion_boxes.push_back(*msg);
+	if(motion_boxes.size() > 64)
+		motion_boxes.pop_front();
+	runPendingFrames();
+}
+
+/* Takes the refined blobs of the frame with the given camera stamp
+ * 
+ * PARAMETERS:
+ *	    - stamp: camera stamp of the frame
+ *	    - boxes: the blobs, in frame coordinates
+ *	    - frame: size of the frame they are in
+ * 
+ * RETURN:
+ *	    - false if chroma published none for the frame
+ */
+bool Fusion_processing::findMotionBoxes(ros::Time stamp, vector< Rect_<int> >& boxes, Size& frame)
+{
+	for(int i = motion_boxes.size() - 1; i >= 0; --i)
+	{
+		const ros_visual_msgs::MotionBoxes& found = motion_boxes[i];
+		if(found.header.stamp != stamp)
+			continue;
+		frame = Size(found.width, found.height);
+		boxes.resize(found.boxes.size());
+		for(int k = 0; k < found.boxes.size(); ++k)
+			boxes[k] = Rect_<int>(found.boxes[k].x, found.boxes[k].y, found.boxes[k].width, found.boxes[k].height);
+		//The older ones belong to frames already handled or skipped
+		motion_boxes.erase(motion_boxes.begin(), motion_boxes.begin() + i + 1);
+		return true;
+	}
+	return false;
+}
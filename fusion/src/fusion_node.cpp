@@ -0,0 +1,9 @@
+#include <fusion.hpp>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "fusion");
+  Fusion_processing fp;
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,25 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include <fusion.hpp>
+
+namespace fusion
+{
+	/* Nodelet wrapper of Fusion_processing. Loaded in the same manager as the other
+	 * ros_visual nodelets, images are passed as shared pointers instead of
+	 * being serialized over TCPROS.
+	 */
+	class FusionNodelet : public nodelet::Nodelet
+	{
+		private:
+		
+			virtual void onInit()
+			{
+				processing.reset(new Fusion_processing(getNodeHandle(), getPrivateNodeHandle()));
+			}
+			
+			boost::shared_ptr<Fusion_processing> processing;
+	};
+}
+
+PLUGINLIB_EXPORT_CLASS(fusion::FusionNodelet, nodelet::Nodelet)
@@ -0,0 +1,259 @@
+#include <golden.hpp>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+
+/* Position fields in the order they are stored */
+static float Position::* const GOLDEN_FIELDS[] = {
+	&Position::x, &Position::y, &Position::z, &Position::area, &Position::ratio,
+	&Position::y_norm, &Position::distance, &Position::depth_std, &Position::depth_valid,
+	&Position::x_diff, &Position::y_diff, &Position::z_diff, &Position::z_diff_norm,
+	&Position::area_diff, &Position::y_norm_diff, &Position::ratio_diff, &Position::distance_diff,
+	&Position::x_delta, &Position::y_delta
+};
+static const char* GOLDEN_NAMES[] = {
+	"x", "y", "z", "area", "ratio",
+	"y_norm", "distance", "depth_std", "depth_valid",
+	"x_diff", "y_diff", "z_diff", "z_diff_norm",
+	"area_diff", "y_norm_diff", "ratio_diff", "distance_diff",
+	"x_delta", "y_delta"
+};
+static const int GOLDEN_FIELD_COUNT = sizeof(GOLDEN_FIELDS)/sizeof(GOLDEN_FIELDS[0]);
+
+/* Hash, filled pixels and mean grey level of the filled depth */
+static void captureDepth(const Mat& gray, GoldenFrame& frame)
+{
+	uint64_t hash 	= 14695981039346656037ULL;
+	long filled 	= 0;
+	double sum 		= 0.0;
+	for(int j = 0; j < gray.rows; ++j)
+	{
+		const uchar* row = gray.ptr<uchar>(j);
+		for(int i = 0; i < gray.cols; ++i)
+		{
+			hash = (hash ^ row[i])*1099511628211ULL;
+			filled += (row[i] != 0);
+			sum += row[i];
+		}
+	}
+	frame.depth_hash   = hash;
+	frame.depth_filled = filled;
+	frame.depth_mean   = gray.empty() ? 0.0 : sum/(double(gray.rows)*gray.cols);
+}
+
+/* Takes the tracked boxes and the filled depth of the pipeline after a frame
+ *
+ * PARAMETERS:
+ *	    - number  : number of the frame in the sequence
+ *	    - pipeline: the pipeline that processed the frame
+ *	    - frame	  : the golden frame to fill
+ *
+ * RETURN --
+ */
+void captureGolden(long number, Pipeline& pipeline, GoldenFrame& frame)
+{
+	People& people = pipeline.tracked();
+	frame.number   = number;
+	frame.boxes.clear();
+	frame.rankings.clear();
+	frame.pos.clear();
+	for(int i = 0; i < people.size(); ++i)
+	{
+		frame.boxes.push_back(people.box(i));
+		frame.rankings.push_back(people.rank(i));
+		frame.pos.push_back(people.pos(i));
+	}
+	captureDepth(pipeline.depthGray(), frame);
+}
+
+/* The same for the output of any other implementation of the stages
+ *
+ * PARAMETERS:
+ *	    - number	: number of the frame in the sequence
+ *	    - boxes		: tracked boxes
+ *	    - rankings	: their rankings
+ *	    - pos		: their features
+ *	    - depth_gray: the filled grayscale depth
+ *	    - frame		: the golden frame to fill
+ *
+ * RETURN --
+ */
+void captureGolden(long number, const vector< Rect_<int> >& boxes, const vector<float>& rankings, const vector<Position>& pos, const Mat& depth_gray, GoldenFrame& frame)
+{
+	frame.number   = number;
+	frame.boxes    = boxes;
+	frame.rankings = rankings;
+	frame.pos 	   = pos;
+	captureDepth(depth_gray, frame);
+}
+
+/* Writes a frame, floats with 9 significant digits so they read back exactly */
+void writeGolden(ostream& out, const GoldenFrame& frame)
+{
+	out<<"frame "<<frame.number<<" "<<frame.boxes.size()<<" "<<hex<<frame.depth_hash<<dec
+	   <<" "<<frame.depth_filled<<" "<<setprecision(9)<<frame.depth_mean<<"\n";
+	for(int b = 0; b < frame.boxes.size(); ++b)
+	{
+		const Rect& box = frame.boxes[b];
+		out<<"box "<<box.x<<" "<<box.y<<" "<<box.width<<" "<<box.height<<" "<<frame.rankings[b];
+		for(int f = 0; f < GOLDEN_FIELD_COUNT; ++f)
+			out<<" "<<frame.pos[b].*GOLDEN_FIELDS[f];
+		out<<"\n";
+	}
+}
+
+/* Reads a float token, nan and inf included */
+template<typename T>
+static bool readValue(istream& in, T& value)
+{
+	string token;
+	if(!(in>>token))
+		return false;
+	char* end;
+	value = strtod(token.c_str(), &end);
+	return *end == '\0';
+}
+
+/* Reads the next frame
+ *
+ * RETURN:
+ *	    - false at the end of the file or on a malformed frame
+ */
+bool readGolden(istream& in, GoldenFrame& frame)
+{
+	string tag;
+	size_t count;
+	if(!(in>>tag) || tag != "frame" || !(in>>frame.number>>count>>hex>>frame.depth_hash>>dec>>frame.depth_filled) || !readValue(in, frame.depth_mean))
+		return false;
+	frame.boxes.resize(count);
+	frame.rankings.resize(count);
+	frame.pos.assign(count, Position());
+	for(int b = 0; b < count; ++b)
+	{
+		Rect& box = frame.boxes[b];
+		if(!(in>>tag) || tag != "box" || !(in>>box.x>>box.y>>box.width>>box.height) || !readValue(in, frame.rankings[b]))
+			return false;
+		for(int f = 0; f < GOLDEN_FIELD_COUNT; ++f)
+			if(!readValue(in, frame.pos[b].*GOLDEN_FIELDS[f]))
+				return false;
+	}
+	return true;
+}
+
+/* Writes the tolerance line, it has to come before the first frame */
+void writeGoldenTolerance(ostream& out, const GoldenTolerance& tolerance)
+{
+	out<<"tolerance "<<tolerance.box<<" "<<setprecision(9)<<tolerance.rankings<<" "<<tolerance.features
+	   <<" "<<tolerance.depth_mean<<" "<<tolerance.depth_filled<<"\n";
+}
+
+/* Reads the tolerance line at the start of a golden file
+ *
+ * RETURN:
+ *	    - false if the file has none, the stream is left at the first frame
+ */
+bool readGoldenTolerance(istream& in, GoldenTolerance& tolerance)
+{
+	streampos start = in.tellg();
+	string tag;
+	if(!(in>>tag) || tag != "tolerance")
+	{
+		in.clear();
+		in.seekg(start);
+		return false;
+	}
+	return (in>>tolerance.box) && readValue(in, tolerance.rankings) && readValue(in, tolerance.features)
+		&& readValue(in, tolerance.depth_mean) && readValue(in, tolerance.depth_filled);
+}
+
+static double relativeError(double expected, double actual)
+{
+	if(expected == actual || (expected != expected && actual != actual))
+		return 0.0;
+	
+	//NaN on one side only is never within a tolerance
+	if(expected != expected || actual != actual)
+		return numeric_limits<double>::infinity();
+	return fabs(expected - actual)/max(1.0, fabs(expected));
+}
+
+/* Largest move of an edge of the box, in pixels */
+static int boxShift(const Rect& expected, const Rect& actual)
+{
+	int left   = abs(expected.x - actual.x);
+	int top    = abs(expected.y - actual.y);
+	int right  = abs(expected.br().x - actual.br().x);
+	int bottom = abs(expected.br().y - actual.br().y);
+	return max(max(left, top), max(right, bottom));
+}
+
+/* Compares a frame with its golden output. The number of boxes must match
+ * exactly, the box edges within tolerance.box pixels, the rankings within
+ * tolerance.rankings, features within tolerance.features and the filled depth bit exactly
+ * unless the tolerance allows its mean grey level (absolute) and its filled
+ * pixel count (relative) to move
+ *
+ * PARAMETERS:
+ *	    - expected	: the golden frame
+ *	    - actual	: the frame just processed
+ *	    - tolerance	: see GoldenTolerance
+ *	    - report	: accumulates the differences
+ *	    - log		: the first differences of the frame are written here
+ *
+ * RETURN --
+ */
+void compareGolden(const GoldenFrame& expected, const GoldenFrame& actual, const GoldenTolerance& tolerance, GoldenReport& report, ostream& log)
+{
+	++report.frames;
+	if(expected.depth_hash != actual.depth_hash)
+	{
+		double error  = fabs(expected.depth_mean - actual.depth_mean);
+		double filled = relativeError(expected.depth_filled, actual.depth_filled);
+		report.max_depth_mean_error   = max(report.max_depth_mean_error, error);
+		report.max_depth_filled_error = max(report.max_depth_filled_error, filled);
+		if(error > tolerance.depth_mean || filled > tolerance.depth_filled)
+		{
+			++report.depth_mismatch;
+			log<<"frame "<<actual.number<<": filled depth differs, mean "<<expected.depth_mean<<" -> "<<actual.depth_mean
+			   <<", filled "<<expected.depth_filled<<" -> "<<actual.depth_filled<<endl;
+		}
+	}
+
+	if(expected.boxes.size() != actual.boxes.size())
+	{
+		++report.box_mismatch;
+		log<<"frame "<<actual.number<<": "<<expected.boxes.size()<<" boxes expected, "<<actual.boxes.size()<<" tracked"<<endl;
+		return;
+	}
+	for(int b = 0; b < expected.boxes.size(); ++b)
+	{
+		int shift 	= boxShift(expected.boxes[b], actual.boxes[b]);
+		float error = fabs(expected.rankings[b] - actual.rankings[b]);
+		report.max_box_shift 	 = max(report.max_box_shift, shift);
+		report.max_ranking_error = max(report.max_ranking_error, error);
+		if(shift > tolerance.box || error > tolerance.rankings)
+		{
+			++report.box_mismatch;
+			const Rect& e = expected.boxes[b];
+			const Rect& a = actual.boxes[b];
+			log<<"frame "<<actual.number<<" box "<<b<<": ["<<e.x<<" "<<e.y<<" "<<e.width<<" "<<e.height<<"] rank "<<expected.rankings[b]
+			   <<" -> ["<<a.x<<" "<<a.y<<" "<<a.width<<" "<<a.height<<"] rank "<<actual.rankings[b]<<endl;
+			return;
+		}
+	}
+	for(int b = 0; b < expected.boxes.size(); ++b)
+	{
+		for(int f = 0; f < GOLDEN_FIELD_COUNT; ++f)
+		{
+			double e = expected.pos[b].*GOLDEN_FIELDS[f];
+			double a = actual.pos[b].*GOLDEN_FIELDS[f];
+			double error = relativeError(e, a);
+			report.max_feature_error = max(report.max_feature_error, error);
+			if(error > tolerance.features)
+			{
+				++report.feature_mismatch;
+				log<<"frame "<<actual.number<<" box "<<b<<": "<<GOLDEN_NAMES[f]<<" "<<e<<" -> "<<a<<endl;
+			}
+		}
+	}
+}
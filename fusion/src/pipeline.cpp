@@ -0,0 +1,352 @@
+#include <pipeline.hpp>
+
+Pipeline::Pipeline(const PipelineConfig& config)
+{
+	configure(config);
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+/* Applies a configuration, the tracked boxes are kept
+ * 
+ * PARAMETERS:
+ *	    - config: the pipeline parameters
+ * 
+ * RETURN --
+ */
+void Pipeline::configure(const PipelineConfig& config)
+{
+	this->config = config;
+	preprocessor.setGamma(config.gamma);
+	preprocessor.setClahe(config.clahe_clip_limit, config.clahe_tiles);
+	motion = MotionDetector(config.back_factor, config.motion_threshold, config.motion_scale);
+	planner.setParams(config.roi);
+}
+
+/* Stage 1: gamma correction and CLAHE of the incoming image. In ROI mode
+ * only inside the regions planned around the tracked boxes, the rest of the
+ * processed frame keeps its last value */
+void Pipeline::preprocess(Frame& frame)
+{
+	if(!config.roi_mode)
+	{
+		frame.regions_only = false;
+		preprocessor.apply(frame.image, frame.processed);
+		return;
+	}
+	frame.regions_only = planner.plan(frame.image.size(), preprocessor.tileSize(frame.image.size()), frame.header.stamp.toSec(), frame.regions);
+	if(frame.regions_only)
+		preprocessor.applyRegions(frame.image, processed, frame.regions);
+	else
+		preprocessor.apply(frame.image, processed);
+	frame.processed = processed;
+}
+
+/* Stage 2: difference from the running average background */
+void Pipeline::detectMotion(Frame& frame)
+{
+	if(frame.regions_only)
+		motion.applyRegions(frame.processed, frame.dif, frame.regions);
+	else
+		motion.apply(frame.processed, frame.dif);
+}
+
+/* Stage 3: moving blobs of the difference image. In pyramid mode they are
+ * detected on the coarse difference and refined at full resolution */
+void Pipeline::detect(Frame& frame)
+{
+	frame.blobs.clear();
+	int scale = motion.pyramidScale();
+	detectBlobs(frame.dif, frame.blobs, max(config.blob_range/scale, 1), 1, false);
+	motion.refine(frame.processed, frame.blobs, config.blob_range);
+}
+
+/* Stage 4: association of the blobs with the tracked boxes */
+void Pipeline::trackBlobs(Frame& frame)
+{
+	track(frame.blobs, people, frame.processed.cols, frame.processed.rows, 3, 5*config.max_rank, config.motion_model ? &config.motion : NULL);
+	if(config.roi_mode)
+	{
+		vector< Rect_<int> > boxes(people.size());
+		for(int i = 0; i < people.size(); ++i)
+			boxes[i] = people.box(i);
+		planner.setTracks(boxes, frame.header.stamp.toSec());
+	}
+}
+
+/* Stage 5: depth, position and features of the tracked boxes, needs a depth frame */
+void Pipeline::extractFeatures(Frame& frame)
+{
+	if(depth_available)
+	{
+		//Integral images are built once per depth frame, on first use and only
+		//for the valid_rms depth_std that reads them
+		if(config.depth_deviation == DEPTH_STD_VALID_RMS && depth_integral.empty())
+			depth_integral.compute(depth_Mat);
+		calculateFeatures(people, depth_Mat, depth_integral, config.depth_estimator, config.depth_deviation, config.feature_threads, &stage_profiler);
+	}
+}
+
+/* Stage 6: populates the results message, stamped with the frame stamp
+ * 
+ * RETURN:
+ *	    - true if there is any tracked box to report
+ */
+bool Pipeline::results(Frame& frame, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg)
+{
+	bool has_boxes = !people.empty();
+	float time_interval = frame_interval.next(frame.header.stamp, config.max_rank);
+	if(has_boxes)
+		fillFusionMsg(people, frame.header.stamp, time_interval, frame_id, fmsg);
+	return has_boxes;
+}
+
+/* Runs all the stages over a frame
+ * 
+ * PARAMETERS:
+ *	    - frame   : the frame, frame.image and frame.header must be set
+ *	    - frame_id: frame of the results header
+ *	    - fmsg	  : the results message to populate
+ * 
+ * RETURN:
+ *	    - true if there is any tracked box to report
+ */
+bool Pipeline::process(Frame& frame, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg)
+{
+	ScopedTimer timer(&stage_profiler, STAGE_PREPROCESS);
+	preprocess(frame);
+	timer.next(STAGE_BACKGROUND);
+	detectMotion(frame);
+	timer.next(STAGE_BLOBS);
+	detect(frame);
+	timer.next(STAGE_TRACK);
+	trackBlobs(frame);
+	timer.next(STAGE_FEATURES);
+	extractFeatures(frame);
+	timer.stop();
+	return results(frame, frame_id, fmsg);
+}
+
+/* Depth preprocessing, the corrected depth is used by the following frames
+ * 
+ * PARAMETERS:
+ *	    - src: depth frame in mm, 32FC1 or 16UC1
+ * 
+ * RETURN --
+ */
+void Pipeline::processDepth(const Mat& src)
+{
+	ScopedTimer timer(&stage_profiler, STAGE_DEPTH_FILTER);
+	cleanDepth(src, depth_gray, depth_Mat, config.min_depth, config.max_depth);
+	depth_available = true;
+	depth_integral.clear();
+}
+
+/* Stage latencies, disabled unless enabled by the owner */
+Profiler& Pipeline::profiler()
+{
+	return stage_profiler;
+}
+
+const Mat& Pipeline::depth() const
+{
+	return depth_Mat;
+}
+
+const Mat& Pipeline::depthGray() const
+{
+	return depth_gray;
+}
+
+People& Pipeline::tracked()
+{
+	return people;
+}
+
+
+Pipeline_processing::Pipeline_processing(ros::NodeHandle nh, ros::NodeHandle local_nh)
+: nh_(nh), it_(nh_)
+{
+	PipelineConfig config;
+	double gamma;
+	double back_factor;
+	string depth_estimator;
+	string depth_std;
+	
+	//Getting the parameters specified by the launch file 
+	local_nh.param("camera_frame" 		  , camera_frame		  , string("camera_link"));
+	local_nh.param("results_topic"		  , results_topic		  , string("results"));
+	local_nh.param("image_topic"		  , image_topic			  , string("/camera/rgb/image_raw"));
+	local_nh.param("depth_topic"		  , depth_topic			  , string("/camera/depth/image_raw"));
+	local_nh.param("image_out_topic"	  , image_out_topic		  , string("/chroma_proc/image"));
+	local_nh.param("image_out_dif_topic"  , image_out_dif_topic   , string("/chroma_proc/image_dif"));
+	local_nh.param("depth_out_image_topic", depth_out_image_topic , string("/depth_proc/image"));
+	local_nh.param("playback_topics"	  , playback_topics		  , false);
+	local_nh.param("use_depth"			  , use_depth			  , false);
+	local_nh.param("debug_images"		  , debug_images		  , false);
+	local_nh.param("gamma"				  , gamma				  , 2.5);
+	local_nh.param("clahe_clip_limit"	  , config.clahe_clip_limit, 1.5);
+	local_nh.param("clahe_tiles"		  , config.clahe_tiles	  , 10);
+	local_nh.param("motion_scale"		  , config.motion_scale	  , 1);
+	local_nh.param("back_factor"		  , back_factor			  , 0.80);
+	local_nh.param("max_depth"			  , config.max_depth	  , DEPTH_MAX);
+	local_nh.param("min_depth"			  , config.min_depth	  , DEPTH_MIN);
+	local_nh.param("fps"				  , config.max_rank		  , 30);
+	local_nh.param("depth_estimator"	  , depth_estimator		  , string("kmeans"));
+	local_nh.param("depth_std"			  , depth_std			  , string("mean_abs"));
+	local_nh.param("feature_threads"	  , config.feature_threads , 4);
+	local_nh.param("motion_model"		  , config.motion_model	  , false);
+	local_nh.param("motion_process_noise"	 , config.motion.process_noise 	  , 2.0f);
+	local_nh.param("motion_measurement_noise", config.motion.measurement_noise, 8.0f);
+	local_nh.param("motion_size_noise"		 , config.motion.size_noise 	  , 4.0f);
+	local_nh.param("motion_gate"			 , config.motion.gate 			  , 3.0f);
+	local_nh.param("roi_mode"			  , config.roi_mode		  , false);
+	local_nh.param("roi_margin"			  , config.roi.margin	  , 16);
+	local_nh.param("roi_sweep_period"	  , config.roi.sweep_period , 15);
+	local_nh.param("roi_stable_frames"	  , config.roi.stable_frames , 5);
+	local_nh.param("roi_max_age"		  , config.roi.max_age	  , 0.5);
+	local_nh.param("roi_max_coverage"	  , config.roi.max_coverage , 0.6f);
+	config.gamma 		= gamma;
+	config.back_factor  = back_factor;
+	config.depth_estimator = (depth_estimator == "histogram") ? DEPTH_HISTOGRAM : DEPTH_KMEANS;
+	config.depth_deviation = (depth_std == "valid_rms") ? DEPTH_STD_VALID_RMS : DEPTH_STD_MEAN_ABS;
+	pipeline.configure(config);
+	
+	//Backpressure of the image subscriptions and their counters
+	frame_policy 	= FramePolicy::fromParams(local_nh);
+	image_monitor 	= FrameMonitor("ros_visual/pipeline/image", frame_policy);
+	depth_monitor 	= FrameMonitor("ros_visual/pipeline/depth", frame_policy);
+	diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	uint32_t queue 	= frame_policy.subscriberQueue();
+	
+	//Stage latencies, published on the same topic
+	double profiling_period;
+	local_nh.param("profiling"			  , pipeline.profiler().enabled, false);
+	local_nh.param("profiling_period"	  , profiling_period	  , 5.0);
+	profile_reporter = ProfileReporter("ros_visual/pipeline", profiling_period);
+	
+	if(playback_topics)
+	{
+		ROS_INFO_STREAM_NAMED("Pipeline_processing","Subscribing at compressed topics \n"); 
+		image_sub = it_.subscribe(image_topic, queue, &Pipeline_processing::imageCb, this, image_transport::TransportHints("compressed"));
+		if(use_depth)
+			depth_sub = it_.subscribe(depth_topic, queue, &Pipeline_processing::depthCb, this, image_transport::TransportHints("compressedDepth"));
+	}
+	else
+	{
+		image_sub = it_.subscribe(image_topic, queue, &Pipeline_processing::imageCb, this);
+		if(use_depth)
+			depth_sub = it_.subscribe(depth_topic, queue, &Pipeline_processing::depthCb, this);
+	}
+	
+	results_publisher = local_nh.advertise<ros_visual_msgs::FusionMsg>(results_topic, 1);
+	
+	//Intermediate images are only for debugging
+	if(debug_images)
+	{
+		image_pub 	  = it_.advertise(image_out_topic, 1);
+		image_pub_dif = it_.advertise(image_out_dif_topic, 1);
+		depth_pub 	  = it_.advertise(depth_out_image_topic, 1);
+	}
+}
+
+Pipeline_processing::~Pipeline_processing()
+{
+}
+
+/* Callback function to handle the RGB images, runs all the stages
+ * 
+ * PARAMETERS:
+ * 			- msg : ROS message that contains the image and its metadata
+ * 
+ * RETURN: --
+ */
+void Pipeline_processing::imageCb(const sensor_msgs::ImageConstPtr& msg)
+{
+	ros::Time received = ros::Time::now();
+	cv_bridge::CvImageConstPtr cv_ptr;
+	bool process = image_monitor.accept(msg->header);
+	image_monitor.publish(diagnostics_pub);
+	if(!process)
+		return;
+	
+	ScopedTimer frame_timer(&pipeline.profiler(), STAGE_FRAME);
+	ScopedTimer timer(&pipeline.profiler(), STAGE_DECODE);
+	try
+	{
+		cv_ptr = shareImage(msg, sensor_msgs::image_encodings::MONO8, copy_stats);
+	}
+	catch (cv_bridge::Exception& e)
+	{
+	  ROS_ERROR("cv_bridge exception: %s", e.what());
+	  return;
+	}
+	
+	frame.header = msg->header;
+	frame.image  = cv_ptr->image;
+	//Cameras without a clock leave the stamp empty, like the fusion node use the arrival time
+	if(frame.header.stamp.isZero())
+		frame.header.stamp = received;
+	timer.stop();
+	
+	ros_visual_msgs::FusionMsg fmsg;
+	bool has_results = pipeline.process(frame, camera_frame, fmsg);
+	timer.next(STAGE_PUBLISH);
+	if(has_results)
+	{
+		//Single hop, from the camera frame to the results
+		ros_visual_msgs::FrameHop hop;
+		hop.node 	  = "pipeline";
+		hop.received  = received;
+		hop.published = ros::Time::now();
+		fmsg.hops.push_back(hop);
+		results_publisher.publish(fmsg);
+	}
+	
+	if(debug_images)
+	{
+		image_pub.publish(cv_bridge::CvImage(msg->header, sensor_msgs::image_encodings::MONO8, frame.processed).toImageMsg());
+		image_pub_dif.publish(cv_bridge::CvImage(msg->header, sensor_msgs::image_encodings::MONO8, frame.dif).toImageMsg());
+	}
+	
+	timer.stop();
+	frame_timer.stop();
+	profile_reporter.publish(pipeline.profiler(), diagnostics_pub);
+	
+	//Do not hold the message buffer until the next frame
+	frame.image.release();
+	copy_stats.endFrame();
+}
+
+/* Callback function to handle the depth images
+ * 
+ * PARAMETERS:
+ * 			- msg : ROS message that contains the depth image and its metadata
+ * 
+ * RETURN: --
+ */
+void Pipeline_processing::depthCb(const sensor_msgs::ImageConstPtr& msg)
+{
+	cv_bridge::CvImageConstPtr cv_ptr;
+	bool process = depth_monitor.accept(msg->header);
+	depth_monitor.publish(diagnostics_pub);
+	if(!process)
+		return;
+	
+	try
+	{
+		cv_ptr = shareDepth(msg, copy_stats);
+	}
+	catch (cv_bridge::Exception& e)
+	{
+	  ROS_ERROR("cv_bridge exception: %s", e.what());
+	  return;
+	}
+	
+	pipeline.processDepth(cv_ptr->image);
+	
+	if(debug_images)
+		depth_pub.publish(cv_bridge::CvImage(msg->header, sensor_msgs::image_encodings::TYPE_32FC1, pipeline.depth()).toImageMsg());
+}
@@ -0,0 +1,9 @@
+#include <pipeline.hpp>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "ros_visual_pipeline");
+  Pipeline_processing pp;
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,300 @@
+#include <pipeline.hpp>
+#include <golden.hpp>
+#include <recording.hpp>
+#include <rosbag/bag.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+/* Replays a recorded sequence through the Pipeline as fast as the CPU
+ * allows, without ROS transport, and writes the results and the per frame
+ * timings. The directory holds
+ *
+ * 		- rgb_N.png 	: colour or grayscale frames
+ * 		- depth_N.png 	: 16 bit depth in mm, or depth_N.raw with raw 16 bit or
+ * 						  float depth in mm (needs --raw WxH)
+ * 		- stamps.txt 	: optional, the stamp in seconds of every frame, one
+ * 						  per line in the order of the frames
+ *
+ * frames are paired by their number N, zero padded or not (see
+ * recording.hpp, vision_benchmark reads the same directories). Without
+ * stamps.txt the frames are stamped 1/fps apart.
+ *
+ * --golden-record stores the boxes, rankings, features and filled depth of
+ * every frame, --golden-check compares a run with such a file and exits
+ * with 2 if they differ beyond --tolerance (features, relative),
+ * --depth-mean-tolerance (mean grey level of the filled depth, in grey
+ * levels) and --depth-filled-tolerance (its filled pixel count, relative).
+ * --box-tolerance lets the box edges move by that many pixels and
+ * --ranking-tolerance the rankings by that much. Without any of these
+ * options the tolerance line of the golden file is used, bit exact if it
+ * has none.
+ *
+ * Usage: ros_visual_replay DIR [--bag results.bag] [--topic /fusion/results]
+ * 							[--timings timings.csv] [--fps 30] [--raw WxH]
+ * 							[--depth-estimator histogram|kmeans] [--depth-std mean_abs|valid_rms]
+ * 							[--threads N]
+ * 							[--golden-record FILE | --golden-check FILE]
+ * 							[--tolerance T] [--box-tolerance P] [--ranking-tolerance R]
+ * 							[--depth-mean-tolerance G] [--depth-filled-tolerance T]
+ */
+
+typedef chrono::steady_clock replay_clock;
+
+struct ReplayOptions
+{
+	string dir;
+	string bag;
+	string topic 	= "/fusion/results";
+	string timings;
+	string frame_id = "camera_link";
+	double fps 		= 30.0;
+	Size raw_size 	= Size(640, 480);
+	PipelineConfig config;
+	string golden_record;
+	string golden_check;
+	GoldenTolerance tolerance;
+	bool tolerance_set = false;
+};
+
+static double elapsedMs(replay_clock::time_point& start)
+{
+	replay_clock::time_point now = replay_clock::now();
+	double ms = chrono::duration<double, milli>(now - start).count();
+	start = now;
+	return ms;
+}
+
+/* Lists the rgb frames of the directory in order, with the depth frame of
+ * the same number if there is one
+ */
+static bool listFrames(const string& dir, vector<RecordedFrame>& frames)
+{
+	vector<RecordedFrame> recorded;
+	if(!listRecording(dir, recorded))
+	{
+		cerr<<dir<<" is not a directory"<<endl;
+		return false;
+	}
+	frames.clear();
+	for(int i = 0; i < recorded.size(); ++i)
+		if(!recorded[i].rgb.empty())
+			frames.push_back(recorded[i]);
+	if(frames.empty())
+	{
+		cerr<<"No frames (rgb_N.png) in "<<dir<<endl;
+		return false;
+	}
+	return true;
+}
+
+static bool readStamps(const string& dir, vector<double>& stamps)
+{
+	ifstream in((dir + "/stamps.txt").c_str());
+	double stamp;
+	while(in>>stamp)
+		stamps.push_back(stamp);
+	return !stamps.empty();
+}
+
+static bool parseOptions(int argc, char** argv, ReplayOptions& options)
+{
+	if(argc < 2)
+		return false;
+	options.dir = argv[1];
+	for(int i = 2; i < argc; ++i)
+	{
+		string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if(arg == "--bag" && has_value)
+			options.bag = argv[++i];
+		else if(arg == "--topic" && has_value)
+			options.topic = argv[++i];
+		else if(arg == "--timings" && has_value)
+			options.timings = argv[++i];
+		else if(arg == "--frame-id" && has_value)
+			options.frame_id = argv[++i];
+		else if(arg == "--fps" && has_value)
+			options.fps = max(atof(argv[++i]), 1.0);
+		else if(arg == "--raw" && has_value)
+		{
+			int w, h;
+			if(sscanf(argv[++i], "%dx%d", &w, &h) != 2)
+				return false;
+			options.raw_size = Size(w, h);
+		}
+		else if(arg == "--depth-estimator" && has_value)
+			options.config.depth_estimator = (string(argv[++i]) == "histogram") ? DEPTH_HISTOGRAM : DEPTH_KMEANS;
+		else if(arg == "--depth-std" && has_value)
+			options.config.depth_deviation = (string(argv[++i]) == "valid_rms") ? DEPTH_STD_VALID_RMS : DEPTH_STD_MEAN_ABS;
+		else if(arg == "--threads" && has_value)
+			options.config.feature_threads = max(atoi(argv[++i]), 1);
+		else if(arg == "--motion-model")
+			options.config.motion_model = true;
+		else if(arg == "--roi")
+			options.config.roi_mode = true;
+		else if(arg == "--scale" && has_value)
+			options.config.motion_scale = max(atoi(argv[++i]), 1);
+		else if(arg == "--golden-record" && has_value)
+			options.golden_record = argv[++i];
+		else if(arg == "--golden-check" && has_value)
+			options.golden_check = argv[++i];
+		else if(arg == "--tolerance" && has_value)
+			options.tolerance.features = atof(argv[++i]);
+		else if(arg == "--box-tolerance" && has_value)
+			options.tolerance.box = max(atoi(argv[++i]), 0);
+		else if(arg == "--ranking-tolerance" && has_value)
+			options.tolerance.rankings = atof(argv[++i]);
+		else if(arg == "--depth-mean-tolerance" && has_value)
+			options.tolerance.depth_mean = atof(argv[++i]);
+		else if(arg == "--depth-filled-tolerance" && has_value)
+			options.tolerance.depth_filled = atof(argv[++i]);
+		else
+			return false;
+		
+		//A tolerance on the command line replaces the one of the golden file
+		options.tolerance_set |= (arg.find("tolerance") != string::npos);
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	ReplayOptions options;
+	if(!parseOptions(argc, argv, options))
+	{
+		cerr<<"Usage: "<<argv[0]<<" DIR [--bag results.bag] [--topic /fusion/results] [--timings timings.csv]"
+			<<" [--frame-id camera_link] [--fps 30] [--raw WxH] [--depth-estimator histogram|kmeans] [--depth-std mean_abs|valid_rms] [--threads N] [--motion-model] [--roi] [--scale 1|2|4]"
+			<<" [--golden-record FILE | --golden-check FILE] [--tolerance T] [--box-tolerance P] [--ranking-tolerance R]"
+			<<" [--depth-mean-tolerance G] [--depth-filled-tolerance T]"<<endl;
+		return 1;
+	}
+
+	vector<RecordedFrame> frames;
+	if(!listFrames(options.dir, frames))
+		return 1;
+	vector<double> stamps;
+	if(readStamps(options.dir, stamps) && stamps.size() < frames.size())
+		cerr<<"stamps.txt has "<<stamps.size()<<" stamps for "<<frames.size()<<" frames, the rest are 1/fps apart"<<endl;
+
+	rosbag::Bag bag;
+	if(!options.bag.empty())
+		bag.open(options.bag, rosbag::bagmode::Write);
+	ofstream timings;
+	if(!options.timings.empty())
+	{
+		timings.open(options.timings.c_str());
+		timings<<"frame\tstamp\tboxes\tread\tdepth\tpreprocess\tmotion\tblobs\ttrack\tfeatures\ttotal"<<endl;
+		timings<<fixed<<setprecision(3);
+	}
+
+	ofstream golden_out;
+	ifstream golden_in;
+	if(!options.golden_record.empty())
+		golden_out.open(options.golden_record.c_str());
+	if(!options.golden_check.empty())
+	{
+		golden_in.open(options.golden_check.c_str());
+		if(!golden_in)
+		{
+			cerr<<"Cannot open "<<options.golden_check<<endl;
+			return 1;
+		}
+		GoldenTolerance recorded;
+		if(readGoldenTolerance(golden_in, recorded) && !options.tolerance_set)
+			options.tolerance = recorded;
+	}
+	GoldenFrame golden, expected;
+	GoldenReport report;
+
+	Pipeline pipeline(options.config);
+	Frame frame;
+	Mat depth;
+	long results = 0;
+	double last_stamp = 0.0;
+	replay_clock::time_point replay_start = replay_clock::now();
+	for(int i = 0; i < frames.size(); ++i)
+	{
+		replay_clock::time_point start = replay_clock::now();
+		replay_clock::time_point frame_start = start;
+		double t[8] = {0};
+
+		last_stamp = (i < stamps.size()) ? stamps[i] : last_stamp + 1.0/options.fps;
+		frame.header.seq   = i;
+		frame.header.stamp = ros::Time(last_stamp);
+		frame.image 	   = imread(frames[i].rgb, 0);
+		if(frame.image.empty())
+		{
+			cerr<<"Cannot read "<<frames[i].rgb<<", skipped"<<endl;
+			continue;
+		}
+		bool has_depth = !frames[i].depth.empty() && readRecordedDepth(frames[i].depth, options.raw_size, depth);
+		t[0] = elapsedMs(start);
+
+		//Same order as the nodes, the depth frame is ready before the rgb one is fused
+		if(has_depth)
+			pipeline.processDepth(depth);
+		t[1] = elapsedMs(start);
+		pipeline.preprocess(frame);
+		t[2] = elapsedMs(start);
+		pipeline.detectMotion(frame);
+		t[3] = elapsedMs(start);
+		pipeline.detect(frame);
+		t[4] = elapsedMs(start);
+		pipeline.trackBlobs(frame);
+		t[5] = elapsedMs(start);
+		pipeline.extractFeatures(frame);
+		t[6] = elapsedMs(start);
+
+		ros_visual_msgs::FusionMsg fmsg;
+		if(pipeline.results(frame, options.frame_id, fmsg))
+		{
+			++results;
+			if(bag.isOpen())
+				bag.write(options.topic, frame.header.stamp, fmsg);
+		}
+		t[7] = chrono::duration<double, milli>(replay_clock::now() - frame_start).count();
+
+		if(golden_out.is_open() || golden_in.is_open())
+			captureGolden(frames[i].number, pipeline, golden);
+		if(golden_out.is_open())
+			writeGolden(golden_out, golden);
+		if(golden_in.is_open())
+		{
+			if(!readGolden(golden_in, expected) || expected.number != golden.number)
+			{
+				cerr<<options.golden_check<<" has no output for frame "<<golden.number<<endl;
+				return 2;
+			}
+			compareGolden(expected, golden, options.tolerance, report, cerr);
+		}
+
+		if(timings.is_open())
+		{
+			timings<<frames[i].number<<"\t"<<last_stamp<<"\t"<<fmsg.boxes.size();
+			for(int k = 0; k < 8; ++k)
+				timings<<"\t"<<t[k];
+			timings<<endl;
+		}
+	}
+	if(bag.isOpen())
+		bag.close();
+
+	double wall 	= chrono::duration<double>(replay_clock::now() - replay_start).count();
+	double recorded = frames.size()/options.fps;
+	if(stamps.size() >= 2)
+		recorded = stamps[min(stamps.size(), frames.size()) - 1] - stamps[0];
+	cout<<frames.size()<<" frames, "<<results<<" results in "<<fixed<<setprecision(2)<<wall<<" s ("
+		<<frames.size()/max(wall, 1e-9)<<" fps, "<<recorded/max(wall, 1e-9)<<"x real time)"<<endl;
+
+	if(golden_in.is_open())
+	{
+		cout<<"golden check of "<<report.frames<<" frames: "<<report.box_mismatch<<" box, "<<report.feature_mismatch
+			<<" feature and "<<report.depth_mismatch<<" depth mismatches (max box shift "<<report.max_box_shift<<" px, max feature error "<<scientific<<report.max_feature_error
+			<<", max depth error "<<report.max_depth_mean_error<<" grey levels, "<<report.max_depth_filled_error<<" of the filled pixels)"<<endl;
+		cout<<(report.passed() ? "PASSED" : "FAILED")<<endl;
+		return report.passed() ? 0 : 2;
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <results.hpp>
+
+/* Interval from the previous frame
+ * 
+ * PARAMETERS:
+ *	    - time	: stamp of the frame
+ *	    - fps	: nominal frame rate, for the first frame
+ * 
+ * RETURN:
+ *	    - the interval in seconds, always above 0
+ */
+float FrameInterval::next(ros::Time time, double fps)
+{
+	if(!previous.isZero())
+	{
+		float interval = (time - previous).toSec();
+		if(interval > 0)
+			last = interval;
+	}
+	previous = time;
+	if(!(last > 0))
+		return 1.0/max(fps, 1.0);
+	return last;
+}
+
+/* Populates a ROS message with the bounded boxes detected and their
+ * metadata, the per frame features are divided by the time interval
+ * between the frames. The box ids are the track ids, which stay the same
+ * for the life of a track
+ * 
+ * PARAMETERS:
+ *	    - collection	: object that contains the bounded boxes detected
+ *	    - time			: ROS object that has the timestamp the frame was created
+ *	    - time_interval : seconds since the previous frame, see FrameInterval
+ *	    - frame_id		: frame of the message header
+ *	    - fmsg			: the message to populate
+ * 
+ * 
+ * RETURN --
+ */
+void fillFusionMsg(People& collection, ros::Time time, float time_interval, const string& frame_id, ros_visual_msgs::FusionMsg& fmsg)
+{
+	fmsg.header.stamp = time;
+	fmsg.header.frame_id = frame_id;
+	for(int i = 0; i < collection.size() ; ++i) 
+	{
+		
+		Rect box = collection.box(i);
+		Position pos = collection.pos(i);
+		
+		ros_visual_msgs::Box box_;
+		
+		box_.id = collection.id(i);
+		box_.rect.x = box.x;
+		box_.rect.y = box.y;
+		box_.rect.width = box.width;
+		box_.rect.height = box.height;
+		box_.pos.ratio = pos.ratio;
+		box_.pos.ratio_diff = pos.ratio_diff;
+		box_.pos.distance = pos.distance;
+		box_.pos.distance_diff = pos.distance_diff;
+		box_.pos.x_diff = pos.x_diff/time_interval;
+		box_.pos.x_delta = pos.x_delta/time_interval;
+		box_.pos.y_diff = pos.y_diff/time_interval;
+		box_.pos.y_delta = pos.y_delta/time_interval;
+		box_.pos.y_norm = pos.y_norm;
+		box_.pos.y_norm_diff = pos.y_norm_diff/time_interval;
+		box_.pos.z_diff = pos.z_diff;
+		box_.pos.z_diff_norm = pos.z_diff_norm;
+		box_.pos.depth_std = pos.depth_std;
+		
+		
+		fmsg.boxes.push_back(box_);
+	}
+}
+
+/* Populates the feedback of the tracked boxes to the chroma region of
+ * interest mode
+ * 
+ * PARAMETERS:
+ *	    - collection: the tracked boxes
+ *	    - header	: header of the difference frame they were tracked in
+ *	    - msg		: the message to populate
+ * 
+ * RETURN --
+ */
+void fillTrackRegions(const People& collection, const std_msgs::Header& header, ros_visual_msgs::TrackRegions& msg)
+{
+	msg.header = header;
+	msg.boxes.resize(collection.size());
+	for(int i = 0; i < collection.size(); ++i)
+	{
+		Rect box = collection.box(i);
+		msg.boxes[i].x 		= box.x;
+		msg.boxes[i].y 		= box.y;
+		msg.boxes[i].width  = box.width;
+		msg.boxes[i].height = box.height;
+	}
+}
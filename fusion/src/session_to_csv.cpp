@@ -0,0 +1,135 @@
+#include <session_writer.hpp>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string.h>
+
+/* Bytes of a column of the given type, 0 for an unknown type */
+static size_t fieldSize(uint32_t type)
+{
+	if(type == 't')
+		return 2*sizeof(uint32_t);
+	if(type == 'i')
+		return sizeof(int32_t);
+	if(type == 'f')
+		return sizeof(float);
+	return 0;
+}
+
+/* Converts a binary session log (fusion.bin) back to the tab separated
+ * fusion.csv layout. The columns are read from the schema stored in the
+ * file, so older logs convert with the names they were written with.
+ * 
+ * Usage: session_to_csv fusion.bin [fusion.csv]
+ */
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cerr<<"Usage: "<<argv[0]<<" fusion.bin [fusion.csv]"<<endl;
+		return 1;
+	}
+
+	ifstream in(argv[1], ios::in | ios::binary);
+	if(!in)
+	{
+		cerr<<"Cannot open "<<argv[1]<<endl;
+		return 1;
+	}
+
+	SessionLogHeader header;
+	in.read((char*)&header, sizeof(header));
+	if(!in || memcmp(header.magic, SESSION_LOG_MAGIC, sizeof(header.magic)) != 0)
+	{
+		cerr<<argv[1]<<" is not a session log"<<endl;
+		return 1;
+	}
+	if(header.version != SESSION_LOG_VERSION || header.header_size < sizeof(header))
+	{
+		cerr<<"Unsupported session log version "<<header.version<<endl;
+		return 1;
+	}
+
+	string schema(header.header_size - sizeof(header), '\0');
+	in.read(&schema[0], schema.size());
+	if(!in || schema.size() < size_t(header.field_count)*sizeof(SessionLogField))
+	{
+		cerr<<"Truncated session log header"<<endl;
+		return 1;
+	}
+	if(header.field_count == 0)
+	{
+		cerr<<argv[1]<<" has no columns"<<endl;
+		return 1;
+	}
+
+	//Every column has to lie inside the record, the records are read with it
+	vector<SessionLogField> layout(header.field_count);
+	memcpy(&layout[0], schema.data(), layout.size()*sizeof(SessionLogField));
+	for(int i = 0; i < layout.size(); ++i)
+	{
+		size_t size = fieldSize(layout[i].type);
+		if(size == 0 || uint64_t(layout[i].offset) + size > header.record_size)
+		{
+			cerr<<"Corrupt session log layout, column "<<i<<" has an unknown type or does not fit a "<<header.record_size<<" byte record"<<endl;
+			return 1;
+		}
+	}
+	vector<string> names;
+	size_t pos = layout.size()*sizeof(SessionLogField);
+	for(int i = 0; i < layout.size() && pos < schema.size(); ++i)
+	{
+		names.push_back(string(schema.c_str() + pos));
+		pos += names.back().size() + 1;
+	}
+
+	ofstream file;
+	if(argc > 2)
+		file.open(argv[2], ios::out);
+	ostream& out = (argc > 2) ? file : cout;
+
+	for(int i = 0; i < names.size(); ++i)
+		out<<names[i]<<"\t";
+	out<<"\n";
+
+	//The second column holds the id, negative ids are timestamp only lines
+	vector<char> record(header.record_size);
+	while(in.read(&record[0], record.size()))
+	{
+		int32_t id = -1;
+		if(layout.size() > 1 && layout[1].type == 'i')
+			memcpy(&id, &record[layout[1].offset], sizeof(id));
+
+		for(int i = 0; i < layout.size(); ++i)
+		{
+			const char* value = &record[layout[i].offset];
+			if(i > 0)
+			{
+				if(id < 0)
+					break;
+				out<<"\t";
+			}
+			if(layout[i].type == 't')
+			{
+				uint32_t sec, nsec;
+				memcpy(&sec, value, sizeof(sec));
+				memcpy(&nsec, value + sizeof(sec), sizeof(nsec));
+				out<<sec<<"."<<setw(9)<<setfill('0')<<nsec<<setfill(' ');
+			}
+			else if(layout[i].type == 'i')
+			{
+				int32_t v;
+				memcpy(&v, value, sizeof(v));
+				out<<v;
+			}
+			else
+			{
+				float v;
+				memcpy(&v, value, sizeof(v));
+				out<<v;
+			}
+		}
+		out<<"\n";
+	}
+	return 0;
+}
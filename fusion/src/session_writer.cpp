@@ -0,0 +1,284 @@
+#include <session_writer.hpp>
+#include <chrono>
+#include <stddef.h>
+#include <string.h>
+
+static const char* default_fields[] = {"Timestamp", "Rect_id", "Rect_x", "Rect_y", "Rect_W", "Rect_H",
+	"Box_Ratio", "Box_Ratio_diff", "Distance", "Distance_diff", "x_diff", "x_delta", "y_diff", "y_delta",
+	"y_norm", "y_norm_diff", "Z_Diff", "Z_Diff_Norm", "Depth_Std"};
+
+/* Column layout of SessionLogRecord, in csv order
+ * 
+ * RETURN:
+ * 			- type and offset of every column
+ */
+vector<SessionLogField> sessionLogLayout()
+{
+	vector<SessionLogField> layout;
+	SessionLogField field;
+	field.type = 't'; field.offset = offsetof(SessionLogRecord, sec); 	layout.push_back(field);
+	field.type = 'i'; field.offset = offsetof(SessionLogRecord, id); 	layout.push_back(field);
+	field.type = 'i'; field.offset = offsetof(SessionLogRecord, x); 	layout.push_back(field);
+	field.type = 'i'; field.offset = offsetof(SessionLogRecord, y); 	layout.push_back(field);
+	field.type = 'i'; field.offset = offsetof(SessionLogRecord, width); layout.push_back(field);
+	field.type = 'i'; field.offset = offsetof(SessionLogRecord, height);layout.push_back(field);
+	for(int i = 0; i < SESSION_LOG_VALUES; ++i)
+	{
+		field.type 	 = 'f';
+		field.offset = offsetof(SessionLogRecord, values) + i*sizeof(float);
+		layout.push_back(field);
+	}
+	return layout;
+}
+
+/* Opens the log file in append mode and starts the writer thread
+ * 
+ * PARAMETERS:
+ *	    - path			 : the log file
+ *	    - format		 : csv text or binary records
+ *	    - fields		 : column names of the binary schema (csv_fields)
+ *	    - capacity		 : number of frames the ring can hold
+ *	    - flush_bytes	 : buffered bytes that trigger a write
+ *	    - flush_interval : maximum seconds a record stays in the buffer
+ */
+SessionWriter::SessionWriter(const string& path, Format format, const vector<string>& fields, size_t capacity, size_t flush_bytes, double flush_interval)
+: ring(max(capacity, (size_t)2)), head(0), tail(0), running(true), dropped_records(0),
+  log_format(format), flush_bytes(flush_bytes), flush_interval(flush_interval)
+{
+	file = fopen(path.c_str(), format == BINARY ? "ab" : "a");
+	if(!file)
+		ROS_ERROR("SessionWriter: cannot open %s", path.c_str());
+	else
+	{
+		setvbuf(file, NULL, _IONBF, 0); //the buffer is ours already
+		fseek(file, 0, SEEK_END);
+		if(format == BINARY && ftell(file) == 0)
+			writeHeader(fields);
+	}
+	worker = thread(&SessionWriter::run, this);
+}
+
+/* Stops the writer thread after it has written every queued record */
+SessionWriter::~SessionWriter()
+{
+	running.store(false, memory_order_release);
+	if(worker.joinable())
+		worker.join();
+	if(file)
+		fclose(file);
+	if(dropped_records > 0)
+		ROS_WARN("SessionWriter: %lu records were dropped", (unsigned long)dropped_records);
+}
+
+/* Copies the tracked boxes of a frame into the ring. Called from the
+ * fusion callback only (single producer).
+ * 
+ * PARAMETERS:
+ *	    - collection	: object that contains the bounded boxes detected
+ *	    - time			: ROS object that has the timestamp the frame was created
+ *	    - time_interval : seconds since the previous frame, see FrameInterval
+ * 
+ * RETURN:
+ *	    - false if the ring was full and the record was dropped
+ */
+bool SessionWriter::push(const People& collection, ros::Time time, float time_interval)
+{
+	size_t h = head.load(memory_order_relaxed);
+	if(h - tail.load(memory_order_acquire) >= ring.size())
+	{
+		++dropped_records;
+		return false;
+	}
+
+	Record& record 		 = ring[h % ring.size()];
+	record.time 		 = time;
+	record.time_interval = time_interval;
+	record.rows.resize(collection.size());
+	for(int i = 0; i < collection.size(); ++i)
+	{
+		record.rows[i].id 	= collection.id(i);
+		record.rows[i].box  = collection.box(i);
+		record.rows[i].pos  = collection.pos(i);
+		record.rows[i].rank = collection.rank(i);
+	}
+	head.store(h + 1, memory_order_release);
+	return true;
+}
+
+unsigned long SessionWriter::dropped() const
+{
+	return dropped_records;
+}
+
+/* Writer thread, drains the ring into the buffer and writes it out on the
+ * size and time thresholds. The last records are written on shutdown.
+ */
+void SessionWriter::run()
+{
+	typedef chrono::steady_clock clock;
+	clock::time_point last_flush = clock::now();
+	chrono::duration<double> interval(flush_interval);
+
+	while(true)
+	{
+		bool stopping = !running.load(memory_order_acquire);
+		size_t t 	  = tail.load(memory_order_relaxed);
+		size_t h 	  = head.load(memory_order_acquire);
+		for(; t != h; ++t)
+		{
+			format(ring[t % ring.size()]);
+			tail.store(t + 1, memory_order_release);
+		}
+
+		size_t pending = (log_format == BINARY) ? binary.size() : (size_t)buffer.tellp();
+		if(pending >= flush_bytes || (pending > 0 && clock::now() - last_flush >= interval) || stopping)
+		{
+			flush();
+			last_flush = clock::now();
+		}
+
+		if(stopping)
+			break;
+		if(h == head.load(memory_order_acquire))
+			this_thread::sleep_for(chrono::milliseconds(5));
+	}
+}
+
+/* Fills the columns of one box, the per frame features are divided by the
+ * time interval between the frames as in the csv
+ */
+static void fillRecord(const Position& pos, float time_interval, SessionLogRecord& out)
+{
+	float* v = out.values;
+	v[0]  = pos.ratio;
+	v[1]  = pos.ratio_diff/time_interval;
+	v[2]  = pos.distance/time_interval;
+	v[3]  = pos.distance_diff/time_interval;
+	v[4]  = pos.x_diff/time_interval;
+	v[5]  = pos.x_delta/time_interval;
+	v[6]  = pos.y_diff/time_interval;
+	v[7]  = pos.y_delta/time_interval;
+	v[8]  = pos.y_norm;
+	v[9]  = pos.y_norm_diff/time_interval;
+	v[10] = pos.z_diff/time_interval;
+	v[11] = abs(pos.z_diff)/time_interval;
+	v[12] = pos.depth_std;
+}
+
+void SessionWriter::format(const Record& record)
+{
+	if(log_format == BINARY)
+		formatBinary(record);
+	else
+		formatCSV(record);
+}
+
+/* Formats one frame, same layout as the header fields of the session */
+void SessionWriter::formatCSV(const Record& record)
+{
+	if(record.rows.empty())
+	{
+		buffer<<record.time<<"\n";
+		return;
+	}
+	SessionLogRecord out;
+	for(int i = 0; i < record.rows.size(); ++i)
+	{
+		const Row& row = record.rows[i];
+		if(row.rank > 4)
+		{
+			const Rect_<int>& box = row.box;
+			fillRecord(row.pos, record.time_interval, out);
+			buffer
+				<<record.time<<"\t"
+				<<row.id<<"\t"
+				<<box.x<<"\t"
+				<<box.y<<"\t"
+				<<box.width<<"\t"
+				<<box.height;
+			for(int k = 0; k < SESSION_LOG_VALUES; ++k)
+				buffer<<"\t"<<out.values[k];
+			buffer<<"\n";
+		}
+		else
+		{
+			buffer<<record.time<<"\n";
+		}
+	}
+}
+
+/* Appends the fixed width records of one frame */
+void SessionWriter::formatBinary(const Record& record)
+{
+	SessionLogRecord out;
+	memset(&out, 0, sizeof(out));
+	out.sec  = record.time.sec;
+	out.nsec = record.time.nsec;
+	out.id 	 = -1;
+	if(record.rows.empty())
+	{
+		binary.append((const char*)&out, sizeof(out));
+		return;
+	}
+	for(int i = 0; i < record.rows.size(); ++i)
+	{
+		const Row& row = record.rows[i];
+		SessionLogRecord box_out = out;
+		if(row.rank > 4)
+		{
+			box_out.id 	   = row.id;
+			box_out.x 	   = row.box.x;
+			box_out.y 	   = row.box.y;
+			box_out.width  = row.box.width;
+			box_out.height = row.box.height;
+			fillRecord(row.pos, record.time_interval, box_out);
+		}
+		binary.append((const char*)&box_out, sizeof(box_out));
+	}
+}
+
+/* Writes the header and schema of a new binary log. The names come from
+ * csv_fields, the defaults are used if it does not match the layout.
+ */
+void SessionWriter::writeHeader(const vector<string>& fields)
+{
+	vector<SessionLogField> layout = sessionLogLayout();
+	vector<string> names(default_fields, default_fields + layout.size());
+	if(fields.size() == layout.size())
+		names = fields;
+	else if(!fields.empty())
+		ROS_WARN("SessionWriter: csv_fields has %lu names for %lu columns, using the default names",
+			(unsigned long)fields.size(), (unsigned long)layout.size());
+
+	string schema((const char*)&layout[0], layout.size()*sizeof(SessionLogField));
+	for(int i = 0; i < names.size(); ++i)
+		schema.append(names[i].c_str(), names[i].size() + 1);
+
+	SessionLogHeader header;
+	memcpy(header.magic, SESSION_LOG_MAGIC, sizeof(header.magic));
+	header.version 	   = SESSION_LOG_VERSION;
+	header.field_count = layout.size();
+	header.record_size = sizeof(SessionLogRecord);
+	header.header_size = (sizeof(SessionLogHeader) + schema.size() + 7) & ~7u;
+	schema.resize(header.header_size - sizeof(SessionLogHeader), '\0');
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(schema.data(), 1, schema.size(), file);
+}
+
+/* Writes the buffered data to the file and empties the buffer */
+void SessionWriter::flush()
+{
+	if(log_format == BINARY)
+	{
+		if(file && !binary.empty())
+			fwrite(binary.data(), 1, binary.size(), file);
+		binary.clear();
+		return;
+	}
+	string text = buffer.str();
+	buffer.str("");
+	buffer.clear();
+	if(file && !text.empty())
+		fwrite(text.data(), 1, text.size(), file);
+}
@@ -0,0 +1,521 @@
+#include "baseline.hpp"
+#include <limits.h>
+
+/* The kernels below are the ones of the original nodes and vision library,
+ * kept as they were apart from the undefined behaviour that made their
+ * output depend on the compiler or on the stack:
+ *
+ * 		- depthToGray converted out of range floats straight to uchar, here
+ * 		  they go through a 32 bit int the way x86 converted them
+ * 		- calculateDepth counted the kmeans labels in an uninitialized array
+ * 		- track read the update flags of the boxes it added past their end
+ *
+ * The other stages (frameDif, the depth filling and calculatePosition) were
+ * not rewritten and are called from the vision library.
+ */
+
+/* Gamma correction, the table was built for every frame */
+static void baselineGamma(const Mat& src, Mat& dst, float factor)
+{
+	float inverse_gamma = 1.0/factor;
+	Mat lut_matrix(256, 1, CV_8UC1);
+	uchar* ptr = lut_matrix.ptr<uchar>(0);
+	for( int i = 0; i < 256; ++i)
+		ptr[i] =  saturate_cast<uchar>(pow(i/255.0, inverse_gamma)*255.0);
+	LUT(src, lut_matrix, dst);
+}
+
+/* detectBlobs before the connected components labelling */
+static void baselineDetectBlobs(const Mat& src, vector< Rect_<int> >& colour_areas, int range, int subsampling)
+{
+	bool flag 	 		   = false;
+	int cols     		   = src.cols;
+	int rows 	 		   = src.rows;
+	int channels 		   = src.channels();
+	int size 			   = cols*rows*channels;
+
+	//Starting from the 1st non-zero pixel it starts forming rectangles (range x range)
+	//and fuses them if their intersection is above a certain threshold.
+	const uchar *dif = src.ptr<uchar>(0);
+	for(int x = 0; x < size; x = x + subsampling*channels)
+	{
+		if(dif[x] != 0)
+		{
+			int i = floor((x/channels)%(cols));
+			int j = floor(x/(cols*channels));
+
+			//If the rect is out of bounds skip
+			if((i + range >= cols) || (j + range >= rows))
+				continue;
+
+			Rect_<int> removal = Rect(i, j, range , range);
+
+			if(!colour_areas.empty())
+			{
+				for(int k = 0; k < colour_areas.size(); k++)
+				{
+					Rect_<int> rect   = colour_areas[k];
+					Rect all 		  = removal | rect;
+					Rect intersection = removal & rect;
+					int threshold 	  = intersection.area();
+
+					if(threshold > 0)
+					{
+						flag = true;
+						colour_areas[k] = all;
+						break;
+					}
+
+				}
+				if(!flag)
+					colour_areas.push_back(removal);
+				else
+					flag = false;
+			}
+			else
+				colour_areas.push_back(removal);
+		}
+	}
+
+	//In this phase we loop through all the produced rectangles and again try to merge those whose
+	//intersection is above a certain threshold
+	int end = colour_areas.size();
+	for(int a = 0; a < end; a++)
+	{
+		for(int b = a + 1; b < end; b++)
+		{
+			Rect_<int> removal = colour_areas[a];
+			Rect_<int> rect    = colour_areas[b];
+			Rect all 		   = removal | rect;
+			Rect intersection  = removal & rect;
+			int threshold = intersection.area();
+			if(threshold == 0)
+			{
+				int y_distance = 0;
+				if (removal.y < rect.y)
+					y_distance = rect.y - (removal.y + removal.height);
+				else
+					y_distance = removal.y - (rect.y + rect.height);
+				if(y_distance < rows/20)
+				{
+					int y_temp 	 = removal.y;
+					removal.y 	 = rect.y;
+					intersection = removal & rect;
+					threshold 	 = intersection.area();
+					if(threshold == 0)
+					{
+						int x_distance = cols;
+						if (removal.x < rect.x)
+							x_distance = rect.x - (removal.x + removal.width);
+						else
+							x_distance = removal.x - (rect.x + rect.width);
+
+						float area_thres = max(removal.area(), rect.area());
+						if((x_distance < cols/50) && (all.area() < 2*area_thres))
+						{
+							threshold = 1;
+						}
+					}
+					removal.y = y_temp;
+				}
+			}
+
+			if(threshold > 0)
+			{
+				colour_areas[a] = all;
+				colour_areas[b] = colour_areas.back();
+				colour_areas.pop_back();
+				a = -1;
+				end--;
+				break;
+			}
+
+		}
+	}
+
+	//Filter out erroneous areas (dimensions < 0) that sometimes occur
+	for(vector< Rect_<int> >::iterator it = colour_areas.begin(); it < colour_areas.end();)
+	{
+		Rect_<int> rect = *it;
+		if((rect.x < 0) || (rect.y < 0) || (rect.height <= 0) || (rect.width <= 0))
+			it = colour_areas.erase(it);
+		else
+			it++;
+	}
+}
+
+/* track before the spatial index, the track columns and the motion model */
+static void baselineTrack(vector< Rect_<int> >& cur_boxes, vector< Rect_<int> >& tracked_boxes, vector<float>& tracked_rankings, vector<Position>& tracked_pos, int width, int height, int rank, int max_rank)
+{
+	float step  = 1.5;
+	vector<bool> updates(tracked_boxes.size(), false);
+	if(!cur_boxes.empty())
+	{
+		Rect_<int> all;
+		//We reposition every tracked box with a union of
+		//the boxes that fall in its area
+		for(int a = 0; a < tracked_boxes.size(); ++a)
+		{
+			all = Rect(0,0,0,0);
+			for(vector< Rect_<int> >::iterator it = cur_boxes.begin(); it < cur_boxes.end();)
+			{
+				Rect_<int> cur_box = *it;
+				Rect intersection = cur_box | tracked_boxes[a];
+				int threshold = intersection.area();
+				float area_thres = max(cur_box.area(), tracked_boxes[a].area());
+				if(threshold > 0 && threshold < 1.1*area_thres)
+				{
+					if (all.area() == 0)
+						all = cur_box;
+					else
+						all = cur_box | all;
+					it = cur_boxes.erase(it);
+				}
+				else
+					++it;
+			}
+
+			//The reposition rules
+			if(all.area() > 0)
+			{
+				Rect_<int>& tracked = tracked_boxes[a];
+				Position& pos 		= tracked_pos[a];
+				float x_new;
+				float y_new;
+				float w_new;
+				float h_new;
+				if(all.area() > tracked.area())
+				{
+					x_new = (all.x + tracked.x)/2;
+					y_new = (all.y  + tracked.y)/2;
+					w_new = (all.width + tracked.width)/2;
+					h_new = (all.height + tracked.height)/2;
+				}
+				else
+				{
+					float thresh = 1;
+					float factor = 160;
+					float power = 5*float(tracked.area())/float(all.area());
+					float x_dif = (all.x - tracked.x);
+					float y_dif = (all.y - tracked.y);
+					float w_dif = (all.width - tracked.width);
+					float h_dif = (all.height - tracked.height);
+					x_new = tracked.x + x_dif/(power);
+					y_new = tracked.y + y_dif/(power);
+					w_new = tracked.width  + (abs((w_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : w_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
+					h_new = tracked.height + (abs((h_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : h_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
+
+					if(w_new < 0)
+						w_new = 0;
+					if(h_new < 0)
+						h_new = 0;
+				}
+
+				//Ratio feature
+				float ratio = float(tracked.height)/float(tracked.width);
+				pos.ratio_diff = ratio - pos.ratio;
+				pos.ratio      = ratio;
+
+				//Area feature
+				float area = w_new*h_new;
+				pos.area_diff = area - pos.area;
+				pos.area      = area;
+
+				//x_diff and y_diff
+				float x_diff = (x_new - tracked.x)/area;
+				float y_diff = (y_new - tracked.y)/area;
+				pos.x_delta = x_diff - pos.x_diff;
+				pos.y_delta = y_diff - pos.y_diff;
+				pos.x_diff  = x_diff;
+				pos.y_diff  = y_diff;
+
+				//y_norm
+				float y_norm = y_new/area;
+				pos.y_norm_diff = y_norm - pos.y_norm;
+				pos.y_norm 	    = y_norm;
+
+				//Distance feature
+				int x1 = (x_new + w_new/2);
+				int y1 = (y_new + h_new/2);
+				int x2 = (tracked.x + tracked.width/2);
+				int y2 = (tracked.y + tracked.height/2);
+				float distance = sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2))/area;
+				pos.distance_diff = distance - pos.distance;
+				pos.distance      = distance;
+
+				//assign the new values
+				tracked.x 	   = x_new;
+				tracked.y  	   = y_new;
+				tracked.width  = w_new;
+				tracked.height = h_new;
+
+				//check we did not exceed the limits
+				if(tracked.x + tracked.width > width)
+					tracked.width = width - tracked.x;
+				if(tracked.y + tracked.height > height)
+					tracked.height = height - tracked.y;
+
+				updates.at(a) = true;
+			}
+		}
+		for(int a = 0; a < cur_boxes.size(); ++a)
+		{
+			tracked_pos.push_back(Position());
+			tracked_boxes.push_back(cur_boxes[a]);
+			tracked_rankings.push_back(rank + step);
+		}
+
+		//Merge the tracked boxes that are close to each other, the update
+		//flag stays in the slot of the removed box
+		int end = tracked_boxes.size();
+		for(int a = 0; a < end; ++a)
+		{
+			for(int b = a + 1; b < end; ++b)
+			{
+				Rect_<int> removal = tracked_boxes[a];
+				Rect_<int> rect    = tracked_boxes[b];
+				Rect all 		   = removal | rect;
+
+				int y_distance = height;
+				if (removal.y < rect.y)
+					y_distance = rect.y - (removal.y + removal.height);
+				else
+					y_distance = removal.y - (rect.y + rect.height);
+
+				int threshold = 0;
+				if(y_distance < height/20)
+				{
+					removal.y = rect.y;
+					threshold = (removal & rect).area();
+				}
+				if(threshold > 0)
+				{
+					float rank_ratio = (tracked_rankings[a] + tracked_rankings[b])/(max_rank);
+					if(rank_ratio < 1.1)
+					{
+						tracked_boxes[a] = all;
+						tracked_boxes[b] = tracked_boxes.back();
+						tracked_boxes.pop_back();
+
+						tracked_rankings[b] = tracked_rankings.back();
+						tracked_rankings.pop_back();
+
+						tracked_pos[b] = tracked_pos.back();
+						tracked_pos.pop_back();
+						b = a;
+						--end;
+					}
+				}
+			}
+		}
+	}
+
+	//The added boxes were not updated, the original read past the flags
+	updates.resize(tracked_boxes.size(), false);
+
+	//Update the rankings
+	for(int a = 0; a < tracked_boxes.size(); ++a)
+	{
+		if (updates[a] == true)
+		{
+			if(tracked_rankings[a] <= max_rank)
+				tracked_rankings[a] = tracked_rankings[a] + step;
+		}
+		tracked_rankings[a] = tracked_rankings[a] - 1;
+	}
+
+	//Delete those that fall below 0 rank
+	for(int a = 0; a < tracked_rankings.size();)
+	{
+		if(tracked_rankings[a] < rank || tracked_boxes[a].area() < rank)
+		{
+			tracked_rankings.erase(tracked_rankings.begin() + a);
+			tracked_pos.erase(tracked_pos.begin() + a);
+			tracked_boxes.erase(tracked_boxes.begin() + a);
+		}
+		else
+			++a;
+	}
+}
+
+/* depthToGray of 32FC1 depths before the clamping kernels */
+static void baselineDepthToGray(const Mat& src, Mat& dst, float min_depth, float max_depth)
+{
+	Mat temp_img(src.rows, src.cols, CV_8UC1);
+	int cols = src.cols;
+	int rows = src.rows;
+	if(src.isContinuous())
+	{
+	    cols *= rows;
+	    rows = 1;
+	}
+	for(int i = 0; i < rows; i++)
+	{
+		const float* cur = src.ptr<float>(i);
+		uchar* Ii = temp_img.ptr<uchar>(i);
+		for(int j = 0; j < cols; j++)
+		{
+			float v = (255*((cur[j] - min_depth)/(max_depth - min_depth)));
+			Ii[j] = (uchar)((fabs(v) < 2147483648.0f) ? (int)v : INT_MIN);
+		}
+	}
+	dst = temp_img;
+}
+
+/* grayToDepth before the lookup table */
+static void baselineGrayToDepth(const Mat& src, Mat& dst, float max_depth)
+{
+	Mat temp_img(src.rows, src.cols, CV_32FC1);
+	int cols = src.cols;
+	int rows = src.rows;
+	if(src.isContinuous())
+	{
+	    cols *= rows;
+	    rows = 1;
+	}
+	for(int i = 0; i < rows; i++)
+	{
+		const uchar* cur = src.ptr<uchar>(i);
+		float* Ii = temp_img.ptr<float>(i);
+		for(int j = 0; j < cols; j++)
+			Ii[j] = (max_depth*(float(cur[j])/(255.0)));
+	}
+	dst = temp_img;
+}
+
+/* calculateDepth before the estimators, kmeans draws from the global RNG */
+static float baselineCalculateDepth(const Mat& src, Position& pos)
+{
+	Mat labels;
+	Mat centers;
+	int clusters = 3;
+	int attempts = 3;
+	int j = 0;
+	float depth= 0.0;
+	float dif = 1000.0;
+	float temp_depth = 0.0;
+	int occur[3] = {0, 0, 0};
+	int row_start = src.rows/4;
+	int col_start = src.cols/4;
+
+	Mat samples(4*row_start * col_start, 1, CV_32F);
+	for( int y = 0; y < 2*row_start; ++y)
+		for( int x = 0; x < 2*col_start; ++x)
+			samples.at<float>(y + 2*x*row_start) = src.at<float>(y + row_start ,x + col_start);
+	kmeans(samples, clusters, labels, TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 1000, 10), attempts, KMEANS_PP_CENTERS, centers);
+	for(int k = 0; k < labels.rows; ++k)
+		++occur[labels.at<int>(k)];
+
+	while(j < clusters && (temp_depth < 1000.0 || dif > 1000))
+	{
+		int* it = max_element(occur, occur + clusters);
+		int index = distance(occur, it);
+		temp_depth = centers.at<float>(index);
+		occur[index]= 0;
+		if(pos.z > 0)
+			dif = abs(pos.z - temp_depth);
+		else
+			dif = 0.0;
+		++j;
+	}
+	if (j < clusters)
+		depth = temp_depth;
+
+	return depth;
+}
+
+
+/* The global RNG starts from its default state, as in a new fusion process */
+BaselinePipeline::BaselinePipeline(const PipelineConfig& config)
+: config(config)
+{
+	theRNG() = RNG();
+}
+
+/* Gamma correction and CLAHE, a new CLAHE for every frame */
+void BaselinePipeline::preprocess(Frame& frame)
+{
+	Ptr<CLAHE> clahe = createCLAHE();
+	clahe->setClipLimit(config.clahe_clip_limit);
+	clahe->setTilesGridSize(Size(config.clahe_tiles, config.clahe_tiles));
+	baselineGamma(frame.image, frame.processed, config.gamma);
+	clahe->apply(frame.processed, frame.processed);
+}
+
+/* Difference from the running average background, blended in float */
+void BaselinePipeline::detectMotion(Frame& frame)
+{
+	if(ref.rows == 0)
+		ref = frame.processed.clone();
+	frameDif(frame.processed, ref, frame.dif, config.motion_threshold);
+
+	float backFactor = config.back_factor;
+	int size 		 = ref.rows*ref.cols*ref.channels();
+	const uchar* cur = frame.processed.ptr<uchar>(0);
+	uchar* back 	 = ref.ptr<uchar>(0);
+	for(int x = 0; x < size; ++x)
+		back[x] = cur[x]*(1-backFactor)+ back[x]*backFactor;
+}
+
+void BaselinePipeline::detect(Frame& frame)
+{
+	frame.blobs.clear();
+	baselineDetectBlobs(frame.dif, frame.blobs, config.blob_range, 1);
+}
+
+void BaselinePipeline::trackBlobs(Frame& frame)
+{
+	baselineTrack(frame.blobs, tracked_boxes, tracked_rankings, tracked_pos, frame.dif.cols, frame.dif.rows, 3, 5*config.max_rank);
+}
+
+/* Depth, depth_std and position of every box. depth_std was computed in
+ * place, so a box sees the deviations written by the boxes before it */
+void BaselinePipeline::extractFeatures(Frame& frame)
+{
+	if(!depth_available)
+		return;
+	for(int i = 0; i < tracked_boxes.size(); ++i)
+	{
+		Mat depth_rect = depth_Mat(tracked_boxes[i]);
+		Position& pos  = tracked_pos[i];
+		try
+		{
+			float depth = baselineCalculateDepth(depth_rect, pos);
+			pos.z_diff  = depth - pos.z;
+			if(depth != 0)
+				pos.z = depth;
+			absdiff(depth_rect, pos.z, depth_rect);
+			pos.depth_std = sum(depth_rect)[0]/(depth_rect.rows*depth_rect.cols);
+		}
+		catch(exception& e)
+		{
+			printf("%s %s", "Calculate depth failed: ", e.what());
+		}
+
+		try
+		{
+			calculatePosition(tracked_boxes[i], pos);
+		}
+		catch(exception& e)
+		{
+			printf("%s %s", "Calculate position failed: ", e.what());
+		}
+	}
+}
+
+/* Depth preprocessing of the depth node, the depth arrived as 32FC1 */
+void BaselinePipeline::processDepth(const Mat& src)
+{
+	int morph_size = 2;
+	Mat depth;
+	src.convertTo(depth, CV_32F);
+	baselineDepthToGray(depth, depth_gray, config.min_depth, config.max_depth);
+
+	Mat element = getStructuringElement(MORPH_RECT, Size( 2*morph_size + 1, 2*morph_size+1 ), Point( morph_size, morph_size ) );
+	morphologyEx(depth_gray, depth_gray, MORPH_CLOSE, element);
+	rectFill(depth_gray, 0.3, 2);
+	upVerticalFill(depth_gray, 0.3, true);
+
+	baselineGrayToDepth(depth_gray, depth_Mat, config.max_depth);
+	depth_available = true;
+}
@@ -0,0 +1,56 @@
+#ifndef BASELINE_HPP
+#define BASELINE_HPP
+#include <vector>
+
+#include <pipeline.hpp>
+#include <golden.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* The chroma, depth and fusion processing of the original nodes, before the
+ * detection, background, depth and feature kernels were rewritten, staged
+ * like the Pipeline. golden_record records the golden output of the test
+ * sequence from it, so a rewrite that moves the output shows up against it.
+ * Only the undefined behaviour of the original code is pinned down, see
+ * baseline.cpp. It is not part of the nodes or of ros_visual_replay.
+ */
+class BaselinePipeline
+{
+	public:
+
+		BaselinePipeline(const PipelineConfig& config = PipelineConfig());
+
+		//stages, in the order of the Pipeline
+		void preprocess(Frame& frame);
+		void detectMotion(Frame& frame);
+		void detect(Frame& frame);
+		void trackBlobs(Frame& frame);
+		void extractFeatures(Frame& frame);
+		void processDepth(const Mat& src);
+
+		const vector< Rect_<int> >& boxes() const { return tracked_boxes; }
+		const vector<float>& rankings() const { return tracked_rankings; }
+		const vector<Position>& positions() const { return tracked_pos; }
+		const Mat& depthGray() const { return depth_gray; }
+
+	private:
+
+		PipelineConfig config;
+		Mat ref;
+
+		vector< Rect_<int> > tracked_boxes;
+		vector<float> tracked_rankings;
+		vector<Position> tracked_pos;
+
+		Mat depth_Mat;
+		Mat depth_gray;
+		bool depth_available = false;
+};
+
+inline void captureGolden(long number, const BaselinePipeline& pipeline, GoldenFrame& frame)
+{
+	captureGolden(number, pipeline.boxes(), pipeline.rankings(), pipeline.positions(), pipeline.depthGray(), frame);
+}
+
+#endif // BASELINE_HPP
@@ -0,0 +1,82 @@
+#include <fstream>
+#include <limits>
+
+#include "baseline.hpp"
+#include "golden_replay.hpp"
+
+/* Records the golden output of a sequence from the baseline kernels, see
+ * BaselinePipeline, for golden_test. The pipeline is replayed over the same
+ * sequence and its deviation from the baseline, measured here, sets the
+ * tolerance line of the file:
+ *
+ * 		- box edges 	: the largest shift plus 1 pixel
+ * 		- rankings 		: the largest difference plus 0.5
+ * 		- features and filled depth : the largest error plus 10 %
+ *
+ * A deviation that is 0 stays bit exact. A different number of tracked
+ * boxes or a feature that is NaN on one side only cannot be tolerated, the
+ * file is not written then.
+ *
+ * Usage: golden_record DIR FILE
+ */
+
+static GoldenTolerance measuredTolerance(const GoldenReport& report)
+{
+	GoldenTolerance tolerance;
+	tolerance.box 		   = report.max_box_shift ? report.max_box_shift + 1 : 0;
+	tolerance.rankings 	   = report.max_ranking_error ? report.max_ranking_error + 0.5 : 0.0;
+	tolerance.features 	   = 1.1*report.max_feature_error;
+	tolerance.depth_mean   = 1.1*report.max_depth_mean_error;
+	tolerance.depth_filled = 1.1*report.max_depth_filled_error;
+	return tolerance;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 3)
+	{
+		cerr<<"Usage: "<<argv[0]<<" DIR FILE"<<endl;
+		return 1;
+	}
+	const string dir = argv[1];
+	vector<GoldenFrame> expected, output;
+	BaselinePipeline baseline(goldenConfig());
+	Pipeline pipeline(goldenConfig());
+	if(!replayPipeline(dir, baseline, expected) || !replayPipeline(dir, pipeline, output) || expected.empty())
+	{
+		cerr<<"Cannot replay "<<dir<<endl;
+		return 1;
+	}
+
+	//Every difference is measured, only the number of boxes has to match
+	GoldenTolerance any;
+	any.box 		 = numeric_limits<int>::max();
+	any.rankings 	 = numeric_limits<float>::max();
+	any.features 	 = numeric_limits<double>::max();
+	any.depth_mean 	 = numeric_limits<double>::max();
+	any.depth_filled = numeric_limits<double>::max();
+	GoldenReport report;
+	for(int i = 0; i < expected.size(); ++i)
+		compareGolden(expected[i], output[i], any, report, cerr);
+	if(!report.passed())
+	{
+		cerr<<"The pipeline does not track the boxes of the baseline, "<<argv[2]<<" not written"<<endl;
+		return 2;
+	}
+
+	GoldenTolerance tolerance = measuredTolerance(report);
+	ofstream out(argv[2]);
+	writeGoldenTolerance(out, tolerance);
+	for(int i = 0; i < expected.size(); ++i)
+		writeGolden(out, expected[i]);
+	if(!out)
+	{
+		cerr<<"Cannot write "<<argv[2]<<endl;
+		return 1;
+	}
+
+	cout<<expected.size()<<" frames recorded. Deviation of the pipeline: max box shift "<<report.max_box_shift
+		<<" px, max ranking error "<<report.max_ranking_error<<", max feature error "<<report.max_feature_error
+		<<", max depth error "<<report.max_depth_mean_error<<" grey levels, "<<report.max_depth_filled_error<<" of the filled pixels"<<endl;
+	return 0;
+}
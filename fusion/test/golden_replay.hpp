@@ -0,0 +1,65 @@
+#ifndef GOLDEN_REPLAY_HPP
+#define GOLDEN_REPLAY_HPP
+#include <vector>
+
+#include <pipeline.hpp>
+#include <golden.hpp>
+#include <recording.hpp>
+
+using namespace std;
+
+/* Replay of test/golden_sequence shared by golden_test and golden_record */
+
+static const double GOLDEN_FPS = 30.0;
+
+/* The configuration the golden output is recorded and checked with. The
+ * baseline has only the kmeans depth estimator, one feature thread keeps
+ * the check independent of the thread count */
+static PipelineConfig goldenConfig()
+{
+	PipelineConfig config;
+	config.depth_estimator = DEPTH_KMEANS;
+	config.feature_threads = 1;
+	return config;
+}
+
+/* Runs the sequence through the stages in the order ros_visual_replay does,
+ * P is the Pipeline or the BaselinePipeline
+ *
+ * RETURN:
+ *	    - false if the directory or one of its frames cannot be read
+ */
+template<typename P>
+static bool replayPipeline(const string& dir, P& pipeline, vector<GoldenFrame>& output)
+{
+	vector<RecordedFrame> recorded;
+	if(!listRecording(dir, recorded))
+		return false;
+	Frame frame;
+	Mat depth;
+	double stamp = 0.0;
+	for(int i = 0; i < recorded.size(); ++i)
+	{
+		if(recorded[i].rgb.empty())
+			continue;
+		stamp += 1.0/GOLDEN_FPS;
+		frame.header.seq   = i;
+		frame.header.stamp = ros::Time(stamp);
+		frame.image 	   = imread(recorded[i].rgb, 0);
+		if(frame.image.empty())
+			return false;
+		if(!recorded[i].depth.empty() && readRecordedDepth(recorded[i].depth, Size(), depth))
+			pipeline.processDepth(depth);
+		pipeline.preprocess(frame);
+		pipeline.detectMotion(frame);
+		pipeline.detect(frame);
+		pipeline.trackBlobs(frame);
+		pipeline.extractFeatures(frame);
+
+		output.push_back(GoldenFrame());
+		captureGolden(recorded[i].number, pipeline, output.back());
+	}
+	return true;
+}
+
+#endif // GOLDEN_REPLAY_HPP
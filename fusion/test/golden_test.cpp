@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+
+#include <pipeline.hpp>
+#include <golden.hpp>
+#include "golden_replay.hpp"
+
+/* Replays the recorded sequence in GOLDEN_SEQUENCE_DIR through the pipeline
+ * and checks every frame against golden.txt, the output of the baseline
+ * kernels (the ones of the original nodes, see test/baseline.hpp) over the
+ * same sequence. ros_visual_replay --golden-check runs the same check over
+ * any recording.
+ *
+ * The sequence is 24 frames of 320x240 with two people crossing in front of
+ * a wall, holes in the depth and a static object. golden_record writes
+ * golden.txt, with the deviation of the pipeline it measured plus a margin
+ * as its tolerance line:
+ *
+ * 		catkin_make -DFUSION_GOLDEN_RECORD=ON
+ * 		rosrun fusion golden_record test/golden_sequence test/golden_sequence/golden.txt
+ */
+
+static bool replaySequence(const string& dir, const PipelineConfig& config, vector<GoldenFrame>& output)
+{
+	Pipeline pipeline(config);
+	return replayPipeline(dir, pipeline, output);
+}
+
+TEST(Golden, SequenceMatchesGoldenFile)
+{
+	const string dir = GOLDEN_SEQUENCE_DIR;
+	ifstream in((dir + "/golden.txt").c_str());
+	ASSERT_TRUE(in.good()) << dir << "/golden.txt is missing, record it with golden_record";
+	GoldenTolerance tolerance;
+	ASSERT_TRUE(readGoldenTolerance(in, tolerance)) << "golden.txt has no tolerance line";
+
+	vector<GoldenFrame> output;
+	ASSERT_TRUE(replaySequence(dir, goldenConfig(), output)) << "cannot replay " << dir;
+	ASSERT_FALSE(output.empty());
+
+	//The sequence has to exercise the tracking, not only the depth filling
+	size_t boxes = 0;
+	GoldenReport report;
+	ostringstream log;
+	GoldenFrame expected;
+	for(int i = 0; i < output.size(); ++i)
+	{
+		ASSERT_TRUE(readGolden(in, expected)) << "golden.txt ends at frame " << output[i].number;
+		ASSERT_EQ(expected.number, output[i].number);
+		compareGolden(expected, output[i], tolerance, report, log);
+		boxes += expected.boxes.size();
+	}
+	EXPECT_GT(boxes, 0u);
+	EXPECT_TRUE(report.passed()) << log.str();
+	RecordProperty("max_box_shift", report.max_box_shift);
+	RecordProperty("max_feature_error", testing::PrintToString(report.max_feature_error));
+}
+
+/* The default configuration of the nodes, the kmeans estimator on several
+ * feature threads, has to give the same output as a serial run and as
+ * itself */
+TEST(Golden, DefaultConfigDoesNotDependOnThreads)
+{
+	const string dir = GOLDEN_SEQUENCE_DIR;
+	PipelineConfig config;
+	ASSERT_EQ(config.depth_estimator, DEPTH_KMEANS);
+	ASSERT_GT(config.feature_threads, 1);
+	vector<GoldenFrame> serial;
+	PipelineConfig serial_config = config;
+	serial_config.feature_threads = 1;
+	ASSERT_TRUE(replaySequence(dir, serial_config, serial)) << "cannot replay " << dir;
+
+	size_t boxes = 0;
+	for(int run = 0; run < 2; ++run)
+	{
+		vector<GoldenFrame> parallel;
+		ASSERT_TRUE(replaySequence(dir, config, parallel));
+		ASSERT_EQ(parallel.size(), serial.size());
+		GoldenReport report;
+		ostringstream log;
+		for(int i = 0; i < serial.size(); ++i)
+		{
+			compareGolden(serial[i], parallel[i], GoldenTolerance(), report, log);
+			boxes += parallel[i].boxes.size();
+		}
+		EXPECT_TRUE(report.passed()) << "run " << run << "\n" << log.str();
+	}
+	EXPECT_GT(boxes, 0u);
+}
+
+TEST(Golden, WriteReadRoundTrip)
+{
+	GoldenFrame frame;
+	frame.number 	   = 7;
+	frame.depth_hash   = 0xcbf29ce484222325ULL;
+	frame.depth_filled = 1234;
+	frame.depth_mean   = 87.123456789;
+	frame.boxes.push_back(Rect_<int>(10, 20, 30, 40));
+	frame.rankings.push_back(3);
+	Position pos;
+	pos.x 		  = 0.5;
+	pos.z 		  = 2.25;
+	pos.depth_std = NAN;
+	frame.pos.push_back(pos);
+
+	GoldenTolerance tolerance;
+	tolerance.box 		   = 3;
+	tolerance.rankings 	   = 1.5;
+	tolerance.features 	   = 0.0123456789;
+	tolerance.depth_filled = 0.02;
+
+	stringstream stream;
+	writeGoldenTolerance(stream, tolerance);
+	writeGolden(stream, frame);
+	GoldenTolerance read_tolerance;
+	GoldenFrame read;
+	ASSERT_TRUE(readGoldenTolerance(stream, read_tolerance));
+	ASSERT_TRUE(readGolden(stream, read));
+	EXPECT_EQ(read_tolerance.box, tolerance.box);
+	EXPECT_FLOAT_EQ(read_tolerance.rankings, tolerance.rankings);
+	EXPECT_DOUBLE_EQ(read_tolerance.features, tolerance.features);
+	EXPECT_DOUBLE_EQ(read_tolerance.depth_filled, tolerance.depth_filled);
+
+	GoldenReport report;
+	ostringstream log;
+	compareGolden(frame, read, GoldenTolerance(), report, log);
+	EXPECT_EQ(read.depth_hash, frame.depth_hash);
+	EXPECT_TRUE(report.passed()) << log.str();
+}
+
+TEST(Golden, ToleranceLineIsOptional)
+{
+	GoldenFrame frame;
+	frame.number = 3;
+	stringstream stream;
+	writeGolden(stream, frame);
+	GoldenTolerance tolerance;
+	EXPECT_FALSE(readGoldenTolerance(stream, tolerance));
+	GoldenFrame read;
+	ASSERT_TRUE(readGolden(stream, read));
+	EXPECT_EQ(read.number, 3);
+}
+
+TEST(Golden, DepthTolerancesAreSeparate)
+{
+	GoldenFrame expected, actual;
+	expected.depth_hash   = 1;
+	expected.depth_filled = 10000;
+	expected.depth_mean   = 100.0;
+	actual 				  = expected;
+	actual.depth_hash 	  = 2;
+	actual.depth_filled   = 10100; 	//1% more filled pixels
+	actual.depth_mean 	  = 100.5; 	//half a grey level
+
+	GoldenTolerance tolerance;
+	tolerance.depth_mean   = 1.0;
+	tolerance.depth_filled = 0.02;
+	GoldenReport passing;
+	ostringstream log;
+	compareGolden(expected, actual, tolerance, passing, log);
+	EXPECT_TRUE(passing.passed()) << log.str();
+	EXPECT_DOUBLE_EQ(passing.max_depth_mean_error, 0.5);
+	EXPECT_DOUBLE_EQ(passing.max_depth_filled_error, 0.01);
+
+	//A grey level tolerance must not let the relative pixel count through
+	tolerance.depth_filled = 0.005;
+	GoldenReport failing;
+	compareGolden(expected, actual, tolerance, failing, log);
+	EXPECT_EQ(failing.depth_mismatch, 1);
+}
+
+TEST(Golden, BoxAndRankingTolerances)
+{
+	GoldenFrame expected, actual;
+	expected.boxes.push_back(Rect_<int>(10, 20, 30, 40));
+	expected.rankings.push_back(6.5);
+	expected.pos.push_back(Position());
+	actual = expected;
+	actual.boxes[0] = Rect_<int>(12, 19, 28, 41); 	//right edge unchanged, left edge 2 px
+	actual.rankings[0] = 5.0;
+
+	GoldenTolerance tolerance;
+	tolerance.box 	   = 2;
+	tolerance.rankings = 1.5;
+	GoldenReport passing;
+	ostringstream log;
+	compareGolden(expected, actual, tolerance, passing, log);
+	EXPECT_TRUE(passing.passed()) << log.str();
+	EXPECT_EQ(passing.max_box_shift, 2);
+
+	tolerance.box = 1;
+	GoldenReport failing;
+	compareGolden(expected, actual, tolerance, failing, log);
+	EXPECT_EQ(failing.box_mismatch, 1);
+}
+
+int main(int argc, char** argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+
+'''
+Reports the camera-to-result latency of a running ros_visual system.
+
+The results are stamped with the camera stamp of the frame they were computed
+from and carry the hops (received / published times) of the nodes the frame
+went through. Every period seconds the percentiles of the total latency and of
+each hop are printed.
+
+USAGE:
+    rosrun ros_visual latency_report.py [_topic:=/fusion/results] [_period:=5.0]
+'''
+
+from __future__ import print_function
+
+import rospy
+import numpy
+from collections import defaultdict
+from ros_visual_msgs.msg import FusionMsg
+
+samples = defaultdict(list)
+
+
+def ms(duration):
+    return duration.to_sec()*1000.0
+
+
+def callback(data):
+    now = rospy.Time.now()
+    stamp = data.header.stamp
+    samples['total'].append(ms(now - stamp))
+
+    # chroma -> fusion (or the single pipeline hop) is the path of the frame,
+    # the depth frame that was used only reports its own processing and age
+    previous = stamp
+    fusion = None
+    for hop in data.hops:
+        samples[hop.node + '_process'].append(ms(hop.published - hop.received))
+        if hop.node == 'depth':
+            continue
+        samples[hop.node + '_wait'].append(ms(hop.received - previous))
+        previous = hop.published
+        if hop.node == 'fusion':
+            fusion = hop
+    if fusion is not None:
+        for hop in data.hops:
+            if hop.node == 'depth':
+                samples['depth_age'].append(ms(fusion.received - hop.published))
+    samples['delivery'].append(ms(now - previous))
+
+
+def report(event):
+    global samples
+    current = samples
+    samples = defaultdict(list)
+    if not current:
+        print('No results received')
+        return
+    print('%-18s %8s %9s %9s %9s %9s' % ('latency (ms)', 'count', 'p50', 'p95', 'p99', 'max'))
+    keys = ['total'] + sorted(k for k in current if k not in ('total', 'delivery')) + ['delivery']
+    for key in keys:
+        values = numpy.array(current.get(key, []))
+        if values.size == 0:
+            continue
+        p50, p95, p99 = numpy.percentile(values, [50, 95, 99])
+        print('%-18s %8d %9.2f %9.2f %9.2f %9.2f' % (key, values.size, p50, p95, p99, values.max()))
+    print('')
+
+
+if __name__ == '__main__':
+    rospy.init_node('latency_report', anonymous=True)
+    topic = rospy.get_param('~topic', '/fusion/results')
+    period = rospy.get_param('~period', 5.0)
+    rospy.Subscriber(topic, FusionMsg, callback, queue_size=100)
+    rospy.Timer(rospy.Duration(period), report)
+    rospy.spin()
@@ -0,0 +1,436 @@
+#include <vision.hpp>
+#include <preprocessing.hpp>
+#include <recording.hpp>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+
+/* Offline benchmark of the vision kernels. Every kernel runs over a sequence
+ * of frames at each requested size and reports the time per frame and the
+ * throughput, so regressions show up without a camera or a ROS graph.
+ *
+ * The frames are either synthetic (people sized boxes walking in front of a
+ * wall, sensor holes in the depth) or loaded from a recorded directory, the
+ * same ros_visual_replay reads (see recording.hpp):
+ *
+ * 		- depth_N.png : 16 bit depth in mm, or depth_N.raw with raw 16 bit
+ * 						or float depth in mm (needs --raw WxH)
+ * 		- rgb_N.png   : colour or grayscale frame (optional)
+ *
+ * The first count frames with a depth frame are used, in order of N. Loaded
+ * frames are resized to every requested size.
+ *
+ * Usage: vision_benchmark [--frames DIR] [--raw WxH] [--sizes 640x480,1280x1024]
+ * 						   [--count N] [--min-time SECONDS] [--csv FILE]
+ */
+
+typedef chrono::steady_clock bench_clock;
+
+/* Frames of one size, the inputs of every kernel are prepared up front so
+ * only the kernel itself is timed
+ */
+struct FrameSet
+{
+	vector<Mat> raw; 	//grayscale frames as captured
+	vector<Mat> gray; 	//preprocessed grayscale frames
+	vector<Mat> dif; 	//thresholded frame differences
+	vector<Mat> depth; 	//depth in mm, CV_32FC1
+	vector<Mat> depth_mm; 	//depth in mm, CV_16UC1 as sensors deliver it
+	vector<Mat> depth_gray; //depth scaled to 0-255 with holes
+	vector< vector< Rect_<int> > > blobs; //detectBlobs output of every dif
+	vector< vector< Rect_<int> > > boxes; //tracked boxes of every frame
+};
+
+struct Options
+{
+	string frames;
+	Size raw_size 	= Size(640, 480);
+	vector<Size> sizes;
+	int count 		= 60;
+	double min_time = 1.0;
+	string csv;
+};
+
+struct Result
+{
+	string kernel;
+	Size size;
+	int runs;
+	double mean; 	//ms per frame
+	double median;
+	double p95;
+};
+
+static const float MIN_DEPTH = 0.0;
+static const float MAX_DEPTH = 6000.0;
+
+/* Synthetic sequence: a wall with a floor gradient and three people sized
+ * boxes moving at different speeds, depth holes in blocks as in reflective
+ * surfaces
+ */
+static void syntheticFrames(Size size, int count, vector<Mat>& gray, vector<Mat>& depth)
+{
+	RNG rng(12345);
+	float sx = size.width/640.0;
+	float sy = size.height/480.0;
+	for(int f = 0; f < count; ++f)
+	{
+		Mat d(size, CV_32FC1);
+		for(int j = 0; j < size.height; ++j)
+		{
+			float* row = d.ptr<float>(j);
+			float z = 4500.0 - 1500.0*j/size.height;
+			for(int i = 0; i < size.width; ++i)
+				row[i] = z;
+		}
+		Mat g(size, CV_8UC1);
+		rng.fill(g, RNG::UNIFORM, 90, 110);
+
+		for(int p = 0; p < 3; ++p)
+		{
+			int w = 70*sx, h = (260 - 40*p)*sy;
+			int x = int(40*sx + (f*(3 + 2*p) + 150*p)*sx) % max(size.width - w, 1);
+			int y = size.height - h - int(20*p*sy);
+			Rect person(x, y, w, h);
+			d(person).setTo(Scalar(1800.0 + 700.0*p));
+			g(person).setTo(Scalar(180 - 30*p));
+		}
+
+		for(int hole = 0; hole < 12; ++hole)
+		{
+			int w = rng.uniform(4, 30)*sx, h = rng.uniform(4, 30)*sy;
+			Rect r(rng.uniform(0, size.width - w), rng.uniform(0, size.height - h), w, h);
+			d(r).setTo(Scalar(0.0));
+		}
+		gray.push_back(g);
+		depth.push_back(d);
+	}
+}
+
+/* Loads up to count depth (and rgb) frames of a recorded sequence */
+static bool loadFrames(const Options& options, vector<Mat>& gray, vector<Mat>& depth)
+{
+	vector<RecordedFrame> frames;
+	if(!listRecording(options.frames, frames))
+	{
+		cerr<<options.frames<<" is not a directory"<<endl;
+		return false;
+	}
+	for(int i = 0; i < frames.size() && (int)depth.size() < options.count; ++i)
+	{
+		Mat d;
+		if(frames[i].depth.empty())
+			continue;
+		if(!readRecordedDepth(frames[i].depth, options.raw_size, d))
+		{
+			cerr<<"Cannot read "<<frames[i].depth<<" (raw frames need --raw WxH), skipped"<<endl;
+			continue;
+		}
+		d.convertTo(d, CV_32FC1);
+
+		Mat g;
+		if(!frames[i].rgb.empty())
+			g = imread(frames[i].rgb, 0);
+		if(g.empty())
+			depthToGray(d, g, MIN_DEPTH, MAX_DEPTH);
+		else if(g.size() != d.size())
+			resize(g, g, d.size());
+		gray.push_back(g);
+		depth.push_back(d);
+	}
+	if(depth.empty())
+	{
+		cerr<<"No frames (depth_N.png or depth_N.raw) in "<<options.frames<<endl;
+		return false;
+	}
+	return true;
+}
+
+/* Builds the inputs of every kernel at the given size */
+static void prepare(const vector<Mat>& gray, const vector<Mat>& depth, Size size, FrameSet& set)
+{
+	ImagePreprocessor preprocessor;
+	MotionDetector motion;
+	People people;
+	for(int f = 0; f < gray.size(); ++f)
+	{
+		Mat g, d, p, dif, dg;
+		resize(gray[f], g, size, 0, 0, INTER_AREA);
+		resize(depth[f], d, size, 0, 0, INTER_NEAREST);
+		preprocessor.apply(g, p);
+		motion.apply(p, dif);
+		depthToGray(d, dg, MIN_DEPTH, MAX_DEPTH);
+
+		vector< Rect_<int> > blobs;
+		detectBlobs(dif, blobs, 15, 1, false);
+		vector< Rect_<int> > current = blobs;
+		track(current, people, size.width, size.height, 3, 150);
+
+		set.raw.push_back(g);
+		set.gray.push_back(p);
+		set.dif.push_back(dif);
+		set.depth.push_back(d);
+		Mat mm;
+		d.convertTo(mm, CV_16UC1);
+		set.depth_mm.push_back(mm);
+		set.depth_gray.push_back(dg);
+		set.blobs.push_back(blobs);
+		vector< Rect_<int> > boxes;
+		for(int i = 0; i < people.size(); ++i)
+			boxes.push_back(people.box(i));
+		set.boxes.push_back(boxes);
+	}
+}
+
+/* Runs kernel(frame) over the frames until both the frame count and the
+ * minimum time are reached. setup(frame) runs before every call and is not
+ * timed, e.g. to copy the frame a kernel modifies in place.
+ */
+template<typename Setup, typename Kernel>
+static Result run(const string& name, const FrameSet& set, const Options& options, Setup setup, Kernel kernel)
+{
+	int frames = set.gray.size();
+	vector<double> times;
+	bench_clock::duration total(0);
+	for(int n = 0; n < frames || chrono::duration<double>(total).count() < options.min_time; ++n)
+	{
+		int f = n % frames;
+		setup(f);
+		bench_clock::time_point start = bench_clock::now();
+		kernel(f);
+		bench_clock::duration elapsed = bench_clock::now() - start;
+		total += elapsed;
+		times.push_back(chrono::duration<double, milli>(elapsed).count());
+	}
+
+	Result result;
+	result.kernel = name;
+	result.size   = set.gray[0].size();
+	result.runs   = times.size();
+	result.mean   = chrono::duration<double, milli>(total).count()/times.size();
+	sort(times.begin(), times.end());
+	result.median = times[times.size()/2];
+	result.p95 	  = times[min<size_t>(times.size() - 1, times.size()*95/100)];
+	return result;
+}
+
+static void noSetup(int)
+{
+}
+
+static void benchmarkSize(const FrameSet& set, const Options& options, vector<Result>& results)
+{
+	Size size = set.gray[0].size();
+	Mat work, out, gray;
+
+	ImagePreprocessor preprocessor;
+	results.push_back(run("preprocess", set, options, noSetup,
+		[&](int f) { preprocessor.apply(set.raw[f], out); }));
+
+	MotionDetector motion;
+	results.push_back(run("motion", set, options, noSetup,
+		[&](int f) { motion.apply(set.gray[f], out); }));
+	
+	vector< Rect_<int> > rects;
+	results.push_back(run("detectBlobs", set, options,
+		[&](int) { rects.clear(); },
+		[&](int f) { detectBlobs(set.dif[f], rects, 15, 1, false); }));
+
+	//Motion and blobs together, coarse to fine above x1: background and blobs
+	//at 1/scale, boxes refined in the frame
+	for(int scale = 1; scale <= 4; scale *= 2)
+	{
+		MotionDetector pyramid(0.80, 255*0.33, scale);
+		results.push_back(run("motion_blobs_x" + to_string(scale), set, options,
+			[&](int) { rects.clear(); },
+			[&](int f) {
+				pyramid.apply(set.gray[f], out);
+				detectBlobs(out, rects, max(15/scale, 1), 1, false);
+				pyramid.refine(set.gray[f], rects, 15);
+			}));
+	}
+
+	//track keeps state, every pass over the sequence starts a new collection
+	People people;
+	vector< Rect_<int> > current;
+	results.push_back(run("track", set, options,
+		[&](int f) { if(f == 0) people = People(); current = set.blobs[f]; },
+		[&](int f) { track(current, people, size.width, size.height, 3, 150); }));
+
+	results.push_back(run("rectFill", set, options,
+		[&](int f) { set.depth_gray[f].copyTo(work); },
+		[&](int f) { rectFill(work, 0.3, 2); }));
+
+	results.push_back(run("upVerticalFill", set, options,
+		[&](int f) { set.depth_gray[f].copyTo(work); },
+		[&](int f) { upVerticalFill(work, 0.3, true); }));
+
+	results.push_back(run("depthToGray", set, options, noSetup,
+		[&](int f) { depthToGray(set.depth[f], gray, MIN_DEPTH, MAX_DEPTH); }));
+
+	results.push_back(run("depthToGray(16u)", set, options, noSetup,
+		[&](int f) { depthToGray(set.depth_mm[f], gray, MIN_DEPTH, MAX_DEPTH); }));
+
+	results.push_back(run("grayToDepth", set, options, noSetup,
+		[&](int f) { grayToDepth(set.depth_gray[f], out, MAX_DEPTH); }));
+
+	results.push_back(run("cleanDepth", set, options, noSetup,
+		[&](int f) { cleanDepth(set.depth[f], gray, out, MIN_DEPTH, MAX_DEPTH); }));
+
+	results.push_back(run("cleanDepth(16u)", set, options, noSetup,
+		[&](int f) { cleanDepth(set.depth_mm[f], gray, out, MIN_DEPTH, MAX_DEPTH); }));
+
+	vector<Mat> storage;
+	Mat back;
+	results.push_back(run("estimateBackground", set, options,
+		[&](int f) { set.depth_gray[f].copyTo(work); },
+		[&](int f) { estimateBackground(work, back, storage, 100, 0.025); }));
+
+	//Depth of every tracked box of the frame
+	DepthEstimator estimators[] = {DEPTH_HISTOGRAM, DEPTH_KMEANS};
+	const char* names[] 		= {"calculateDepth(histogram)", "calculateDepth(kmeans)"};
+	for(int e = 0; e < 2; ++e)
+	{
+		vector<Position> positions;
+		results.push_back(run(names[e], set, options,
+			[&](int f) { positions.assign(set.boxes[f].size(), Position()); },
+			[&](int f)
+			{
+				for(int b = 0; b < set.boxes[f].size(); ++b)
+				{
+					try
+					{
+						calculateDepth(set.depth[f](set.boxes[f][b]), positions[b], estimators[e]);
+					}
+					catch(exception&)
+					{
+					}
+				}
+			}));
+	}
+
+	DepthIntegral integral;
+	People features;
+	results.push_back(run("calculateFeatures", set, options,
+		[&](int f) { features.clear();
+					 for(int b = 0; b < set.boxes[f].size(); ++b)
+						 features.add(set.boxes[f][b], 3.0); },
+		[&](int f) { integral.compute(set.depth[f]);
+					 calculateFeatures(features, set.depth[f], integral); }));
+}
+
+static bool parseSize(const string& text, Size& size)
+{
+	int w, h;
+	char x;
+	istringstream in(text);
+	if(!(in>>w>>x>>h) || x != 'x' || w <= 0 || h <= 0)
+		return false;
+	size = Size(w, h);
+	return true;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+	for(int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if(arg == "--frames" && has_value)
+			options.frames = argv[++i];
+		else if(arg == "--raw" && has_value)
+		{
+			if(!parseSize(argv[++i], options.raw_size))
+				return false;
+		}
+		else if(arg == "--sizes" && has_value)
+		{
+			string list = argv[++i], item;
+			istringstream in(list);
+			while(getline(in, item, ','))
+			{
+				Size size;
+				if(!parseSize(item, size))
+					return false;
+				options.sizes.push_back(size);
+			}
+		}
+		else if(arg == "--count" && has_value)
+			options.count = max(atoi(argv[++i]), 1);
+		else if(arg == "--min-time" && has_value)
+			options.min_time = atof(argv[++i]);
+		else if(arg == "--csv" && has_value)
+			options.csv = argv[++i];
+		else
+			return false;
+	}
+	if(options.sizes.empty())
+	{
+		options.sizes.push_back(Size(640, 480));
+		options.sizes.push_back(Size(1280, 1024));
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parseOptions(argc, argv, options))
+	{
+		cerr<<"Usage: "<<argv[0]<<" [--frames DIR] [--raw WxH] [--sizes 640x480,1280x1024]"
+			<<" [--count N] [--min-time SECONDS] [--csv FILE]"<<endl;
+		return 1;
+	}
+
+	vector<Mat> gray, depth;
+	if(!options.frames.empty() && !loadFrames(options, gray, depth))
+		return 1;
+
+	vector<Result> results;
+	for(int s = 0; s < options.sizes.size(); ++s)
+	{
+		Size size = options.sizes[s];
+		vector<Mat> source_gray, source_depth;
+		if(options.frames.empty())
+			syntheticFrames(size, options.count, source_gray, source_depth);
+		else
+		{
+			source_gray  = gray;
+			source_depth = depth;
+		}
+		FrameSet set;
+		prepare(source_gray, source_depth, size, set);
+		benchmarkSize(set, options, results);
+	}
+
+	cout<<left<<setw(28)<<"kernel"<<right<<setw(11)<<"size"<<setw(8)<<"runs"
+		<<setw(11)<<"mean ms"<<setw(11)<<"median ms"<<setw(11)<<"p95 ms"
+		<<setw(10)<<"fps"<<setw(10)<<"Mpix/s"<<endl;
+	cout<<fixed<<setprecision(3);
+	for(int i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+		ostringstream size;
+		size<<r.size.width<<"x"<<r.size.height;
+		double fps = (r.mean > 0) ? 1000.0/r.mean : 0.0;
+		cout<<left<<setw(28)<<r.kernel<<right<<setw(11)<<size.str()<<setw(8)<<r.runs
+			<<setw(11)<<r.mean<<setw(11)<<r.median<<setw(11)<<r.p95
+			<<setw(10)<<setprecision(1)<<fps<<setw(10)<<fps*r.size.area()/1e6<<setprecision(3)<<endl;
+	}
+
+	if(!options.csv.empty())
+	{
+		ofstream file(options.csv.c_str());
+		file<<"kernel,width,height,runs,mean_ms,median_ms,p95_ms"<<endl;
+		for(int i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			file<<r.kernel<<","<<r.size.width<<","<<r.size.height<<","<<r.runs<<","
+				<<r.mean<<","<<r.median<<","<<r.p95<<endl;
+		}
+	}
+	return 0;
+}
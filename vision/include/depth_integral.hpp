@@ -0,0 +1,46 @@
+#ifndef DEPTH_INTEGRAL_HPP
+#define DEPTH_INTEGRAL_HPP
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Depth statistics of a rectangle, over its valid (non zero, non NaN) pixels */
+struct DepthStats
+{
+	int valid 		   = 0;
+	double mean 	   = 0.0;
+	double std 		   = 0.0;
+	double valid_ratio = 0.0;
+};
+
+/* Integral images of the sum, sum of squares and number of valid pixels of a
+ * depth frame. Built once per depth frame, afterwards the statistics of any
+ * rectangle are four lookups per image and the depth frame is never written.
+ */
+class DepthIntegral
+{
+	public:
+
+		DepthIntegral();
+		~DepthIntegral();
+
+		void compute(const Mat& depth);
+		void clear();
+		bool empty() const;
+
+		DepthStats stats(const Rect& rect) const;
+		double deviation(const Rect& rect, double z) const;
+
+	private:
+
+		Rect clip(const Rect& rect) const;
+		void area(const Rect& rect, double& s, double& sq, int& n) const;
+
+		Mat sum; 	//CV_64F, (rows + 1) x (cols + 1)
+		Mat sqsum; 	//CV_64F, (rows + 1) x (cols + 1)
+		Mat count; 	//CV_32S, (rows + 1) x (cols + 1)
+		bool ready = false;
+};
+
+#endif // DEPTH_INTEGRAL_HPP
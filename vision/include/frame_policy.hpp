@@ -0,0 +1,184 @@
+#ifndef FRAME_POLICY_HPP
+#define FRAME_POLICY_HPP
+#include <ros/ros.h>
+#include <std_msgs/Header.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <diagnostic_msgs/KeyValue.h>
+#include <boost/lexical_cast.hpp>
+#include <string>
+
+/* Backpressure policy of the image subscriptions and the frame counters
+ * published on /diagnostics. Header only, like image_bridge.hpp, the nodes
+ * including it depend on diagnostic_msgs.
+ */
+
+using namespace std;
+
+/* How a node copes with frames arriving faster than it processes them
+ *
+ * 		- latest  : queue of one, a new frame replaces the waiting one
+ * 		- bounded : queue of queue_size frames, the oldest is dropped when full
+ * 		- skip    : queue of one and only every (skip + 1)-th frame is processed
+ */
+struct FramePolicy
+{
+	enum Mode { LATEST, BOUNDED, SKIP };
+
+	Mode mode 	   = LATEST;
+	int queue_size = 1;
+	int skip 	   = 0;
+
+	/* Reads queue_policy, queue_size and skip_frames from the private
+	 * namespace of the node
+	 */
+	static FramePolicy fromParams(const ros::NodeHandle& local_nh)
+	{
+		FramePolicy policy;
+		string mode;
+		local_nh.param("queue_policy", mode				, string("latest"));
+		local_nh.param("queue_size"	 , policy.queue_size	, 5);
+		local_nh.param("skip_frames" , policy.skip		, 1);
+		if(mode == "bounded")
+			policy.mode = BOUNDED;
+		else if(mode == "skip")
+			policy.mode = SKIP;
+		else
+		{
+			if(mode != "latest")
+				ROS_WARN("Unknown queue_policy \"%s\", using latest", mode.c_str());
+			policy.mode = LATEST;
+		}
+		policy.queue_size = max(policy.queue_size, 1);
+		policy.skip 	  = max(policy.skip, 0);
+		return policy;
+	}
+
+	//Queue size to subscribe with
+	uint32_t subscriberQueue() const
+	{
+		return mode == BOUNDED ? queue_size : 1;
+	}
+
+	string name() const
+	{
+		if(mode == BOUNDED)
+			return "bounded(" + boost::lexical_cast<string>(queue_size) + ")";
+		if(mode == SKIP)
+			return "skip(" + boost::lexical_cast<string>(skip) + ")";
+		return "latest";
+	}
+};
+
+/* Counts the frames of one subscription, frames skipped by the policy are
+ * counted separately.
+ *
+ * Gaps in the header sequence numbers are reported as upstream_gaps. They
+ * are not drops of this node: chroma and depth forward the camera header, so
+ * a gap may just as well be a frame skipped or lost by any node upstream or
+ * by the driver, and drivers that leave seq at 0 show no gaps at all. They
+ * are informational and do not raise the diagnostic level.
+ */
+class FrameMonitor
+{
+	public:
+
+		FrameMonitor(const string& name = "", const FramePolicy& policy = FramePolicy(), double period = 1.0)
+		: name(name), policy(policy), period(period)
+		{
+		}
+
+		/* Registers an incoming frame
+		 *
+		 * PARAMETERS:
+		 * 			- header : header of the frame
+		 *
+		 * RETURN:
+		 * 			- false if the policy skips this frame
+		 */
+		bool accept(const std_msgs::Header& header)
+		{
+			++received;
+			if(has_seq && header.seq > last_seq)
+				upstream_gaps += header.seq - last_seq - 1;
+			has_seq  = true;
+			last_seq = header.seq;
+
+			if(policy.mode == FramePolicy::SKIP && (countdown--) > 0)
+			{
+				++skipped;
+				return false;
+			}
+			countdown = policy.skip;
+			++processed;
+			return true;
+		}
+
+		/* Forgets the last sequence number, e.g. after the node was paused,
+		 * so the frames published meanwhile are not counted as gaps
+		 */
+		void reset()
+		{
+			has_seq   = false;
+			countdown = 0;
+		}
+
+		/* Publishes the counters when period seconds have passed since the
+		 * last time
+		 *
+		 * PARAMETERS:
+		 * 			- publisher : advertised on /diagnostics
+		 *
+		 * RETURN: --
+		 */
+		void publish(const ros::Publisher& publisher)
+		{
+			ros::Time now = ros::Time::now();
+			if(!last_publish.isZero() && (now - last_publish).toSec() < period)
+				return;
+			last_publish = now;
+
+			diagnostic_msgs::DiagnosticStatus status;
+			status.name 	   = name;
+			status.hardware_id = name;
+			status.level 	   = diagnostic_msgs::DiagnosticStatus::OK;
+			status.message 	   = "ok";
+			addValue(status, "policy"   , policy.name());
+			addValue(status, "received" , received);
+			addValue(status, "processed", processed);
+			addValue(status, "skipped"  , skipped);
+			addValue(status, "upstream_gaps", upstream_gaps);
+
+			diagnostic_msgs::DiagnosticArray array;
+			array.header.stamp = now;
+			array.status.push_back(status);
+			publisher.publish(array);
+		}
+
+		unsigned long received  = 0;
+		unsigned long processed = 0;
+		unsigned long skipped 	= 0;
+		unsigned long upstream_gaps = 0; 	//sequence gaps, see the class comment
+
+	private:
+
+		template<typename T>
+		static void addValue(diagnostic_msgs::DiagnosticStatus& status, const string& key, const T& value)
+		{
+			diagnostic_msgs::KeyValue kv;
+			kv.key 	 = key;
+			kv.value = boost::lexical_cast<string>(value);
+			status.values.push_back(kv);
+		}
+
+		string name;
+		FramePolicy policy;
+		double period;
+		ros::Time last_publish;
+
+		bool has_seq  = false;
+		uint32_t last_seq = 0;
+		int countdown = 0;
+};
+
+#endif // FRAME_POLICY_HPP
@@ -0,0 +1,109 @@
+#ifndef IMAGE_BRIDGE_HPP
+#define IMAGE_BRIDGE_HPP
+#include <ros/ros.h>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <boost/make_shared.hpp>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+/* Helpers to move images between ROS messages and Mats without deep copies.
+ * Header only, so that the vision library itself does not depend on cv_bridge,
+ * the nodes including it already do.
+ */
+
+using namespace std;
+using namespace cv;
+
+/* Bytes copied while handling frames, to verify the zero-copy path */
+struct CopyStats
+{
+	size_t frame_bytes = 0;
+	size_t last_frame_bytes = 0;
+	size_t total_bytes = 0;
+	size_t frames = 0;
+
+	void add(size_t bytes)
+	{
+		frame_bytes += bytes;
+		total_bytes += bytes;
+	}
+
+	void endFrame()
+	{
+		last_frame_bytes = frame_bytes;
+		frame_bytes = 0;
+		++frames;
+	}
+};
+
+/* Wraps an incoming message in a Mat. The message buffer is shared when the
+ * encoding already matches, otherwise cv_bridge converts it and the bytes of
+ * the conversion are added to the statistics.
+ *
+ * PARAMETERS:
+ * 			- msg 	   : the incoming message
+ * 			- encoding : the encoding the caller needs
+ * 			- stats    : copy statistics to update
+ *
+ * RETURN:
+ * 			- the (read only) image, keep it alive while the Mat is in use
+ */
+inline cv_bridge::CvImageConstPtr shareImage(const sensor_msgs::ImageConstPtr& msg, const string& encoding, CopyStats& stats)
+{
+	cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(msg, encoding);
+	if(msg->data.empty() || cv_ptr->image.data != &msg->data[0])
+		stats.add(cv_ptr->image.total()*cv_ptr->image.elemSize());
+	return cv_ptr;
+}
+
+/* Wraps an incoming depth message in a Mat of depths in mm. Native 16UC1
+ * images are shared as they are (depthToGray and cleanDepth take them), any
+ * other encoding is converted to 32FC1.
+ *
+ * PARAMETERS:
+ * 			- msg 	: the incoming depth message
+ * 			- stats : copy statistics to update
+ *
+ * RETURN:
+ * 			- the (read only) 16UC1 or 32FC1 image, keep it alive while the Mat is in use
+ */
+inline cv_bridge::CvImageConstPtr shareDepth(const sensor_msgs::ImageConstPtr& msg, CopyStats& stats)
+{
+	if(msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+		return shareImage(msg, sensor_msgs::image_encodings::TYPE_16UC1, stats);
+	return shareImage(msg, sensor_msgs::image_encodings::TYPE_32FC1, stats);
+}
+
+/* Prepares an outgoing message and returns a Mat that writes straight into its
+ * buffer. The previous message is reused when nobody else holds it anymore
+ * (published messages may still be queued or shared with nodelets), otherwise
+ * a new one is allocated.
+ *
+ * PARAMETERS:
+ * 			- msg 	   : the outgoing message, allocated or reused
+ * 			- header   : header of the source frame
+ * 			- rows 	   : image height
+ * 			- cols 	   : image width
+ * 			- type 	   : Mat type of the image
+ * 			- encoding : the matching ROS encoding
+ *
+ * RETURN:
+ * 			- Mat header over the message data
+ */
+inline Mat prepareImage(sensor_msgs::ImagePtr& msg, const std_msgs::Header& header, int rows, int cols, int type, const string& encoding)
+{
+	if(!msg || !msg.unique())
+		msg = boost::make_shared<sensor_msgs::Image>();
+	msg->header 	  = header;
+	msg->height 	  = rows;
+	msg->width 		  = cols;
+	msg->encoding 	  = encoding;
+	msg->is_bigendian = 0;
+	msg->step 		  = cols*CV_ELEM_SIZE(type);
+	msg->data.resize(msg->step*rows);
+	return Mat(rows, cols, type, &msg->data[0], msg->step);
+}
+
+#endif // IMAGE_BRIDGE_HPP
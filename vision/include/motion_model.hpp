@@ -0,0 +1,41 @@
+#ifndef MOTION_MODEL_HPP
+#define MOTION_MODEL_HPP
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Noise and gating of the track motion model, in pixels and frames */
+struct MotionParams
+{
+	float process_noise 	= 2.0; 	//std of the acceleration of the box center
+	float measurement_noise = 8.0; 	//std of the detected box center
+	float size_noise 		= 4.0; 	//std of the change of width and height per frame
+	float gate 				= 3.0; 	//association window, in innovation stds
+};
+
+/* Constant velocity Kalman filter of a box. The two axes of the center are
+ * independent [position, velocity] filters and the width and height follow
+ * a random walk, so all the matrices are 2x2 or scalars kept in place and an
+ * update allocates nothing.
+ */
+struct BoxFilter
+{
+	float cx, vx; 		 	//center x and its velocity
+	float pxx, pxv, pvvx; 	//their covariance, pvvx the variance of vx
+	float cy, vy;
+	float pyy, pyv, pvvy;
+	float w, h; 			//size
+	float pw, ph; 			//its variance
+	int age; 				//updates since init
+
+	void init(const Rect_<int>& box, const MotionParams& params);
+	void predict(const MotionParams& params);
+	void update(const Rect_<int>& box, const MotionParams& params);
+	void reset(const Rect_<int>& box);
+
+	Rect_<int> box() const;
+	Rect_<int> window(const MotionParams& params) const;
+};
+
+#endif // MOTION_MODEL_HPP
@@ -0,0 +1,122 @@
+#ifndef PEOPLE_HPP
+#define PEOPLE_HPP
+#include <vector>
+#include <new>
+#include <stdlib.h>
+#include <opencv2/core/core.hpp>
+#include <motion_model.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Measurements and features of a tracked box */
+struct Position
+{
+	float x = 0.0;
+	float y = 0.0;
+	float z = 0.0;
+	float area 	    = 0.0;
+	float ratio     = 0.0;
+	float y_norm    = 0.0;
+	float distance  = 0.0;
+	float depth_std = 0.0;
+	float depth_valid = 0.0;
+
+	float x_diff        = 0.0;
+	float y_diff        = 0.0;
+	float z_diff        = 0.0;
+	float z_diff_norm   = 0.0;
+	float area_diff     = 0.0;
+	float y_norm_diff	= 0.0;
+	float ratio_diff    = 0.0;
+	float distance_diff = 0.0;
+
+	float x_delta   = 0.0;
+	float y_delta   = 0.0;
+};
+
+/* Allocator of cache line (64 byte) aligned storage for the track columns */
+template<typename T>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	AlignedAllocator() {}
+	template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		void* p = 0;
+		if(posix_memalign(&p, 64, max<size_t>(n*sizeof(T), 1)) != 0)
+			throw bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		free(p);
+	}
+
+	template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = vector<T, AlignedAllocator<T> >;
+
+/* Store of the tracked boxes. The data of a track lives in one slot of the
+ * columns (structure of arrays) for its whole life, slots of dead tracks are
+ * recycled through a free list. Every track gets a new id, ids are never
+ * reused.
+ *
+ * The live tracks are visited through an index 0..size()-1 that follows the
+ * tracking order: new tracks are appended, swapRemove moves the last track
+ * into the removed one's place and removeMarked keeps the order. Only the
+ * small order vector changes when tracks are removed, the columns stay put.
+ */
+class People
+{
+	public:
+
+		People();
+		~People();
+
+		int size() const;
+		bool empty() const;
+		void clear();
+
+		int add(const Rect_<int>& box, float rank, const MotionParams& motion = MotionParams());
+		void swapRemove(int index);
+		void removeMarked(const vector<bool>& dead);
+
+		//Access by index in tracking order
+		int slot(int index) const 				{ return order[index]; }
+		int id(int index) const 				{ return ids[order[index]]; }
+		Rect_<int> box(int index) const;
+		void setBox(int index, const Rect_<int>& box);
+		float& rank(int index) 					{ return ranks[order[index]]; }
+		float rank(int index) const 			{ return ranks[order[index]]; }
+		Position& pos(int index) 				{ return positions[order[index]]; }
+		const Position& pos(int index) const 	{ return positions[order[index]]; }
+		BoxFilter& filter(int index) 			{ return filters[order[index]]; }
+
+		//Columns, indexed by slot
+		AlignedVector<int> x;
+		AlignedVector<int> y;
+		AlignedVector<int> width;
+		AlignedVector<int> height;
+		AlignedVector<float> ranks;
+		AlignedVector<int> ids;
+		AlignedVector<Position> positions;
+		AlignedVector<BoxFilter> filters; 	//motion model, used by track when enabled
+
+	private:
+
+		void release(int slot);
+
+		vector<int> order; 		//live slots in tracking order
+		vector<int> free_slots;
+		int next_id = 0;
+};
+
+#endif // PEOPLE_HPP
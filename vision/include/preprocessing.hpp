@@ -0,0 +1,75 @@
+#ifndef PREPROCESSING_HPP
+#define PREPROCESSING_HPP
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Chroma preprocessing stage (gamma correction followed by CLAHE). The gamma
+ * lookup table is rebuilt only when the gamma value changes and the CLAHE
+ * instance is created once, so applying the stage costs no per frame setup.
+ */
+class ImagePreprocessor
+{
+	public:
+
+		ImagePreprocessor(float gamma = 2.5, double clip_limit = 1.5, int tiles = 10);
+		~ImagePreprocessor();
+
+		void setGamma(float gamma);
+		void setClahe(double clip_limit, int tiles);
+		void apply(const Mat& src, Mat& dst);
+		void applyRegions(const Mat& src, Mat& dst, const vector< Rect_<int> >& regions);
+		Size tileSize(const Size& frame) const;
+
+	private:
+
+		float gamma;
+		float lut_gamma = 0.0;
+		double clip_limit;
+		int tiles;
+
+		Mat lut;
+		Ptr<CLAHE> clahe;
+		Mat region_src; 	//buffers of applyRegions
+		Mat region_pad;
+		Mat region_dst;
+};
+
+/* Chroma motion stage. Keeps the running average reference frame and produces
+ * the thresholded difference of every frame from it (see updateBackground).
+ *
+ * With a scale above 1 (pyramid mode) the reference and the difference are
+ * computed on the frame downsampled by scale, so both are scale times
+ * smaller than the frame. The blobs detected on that coarse difference are
+ * brought back to full resolution with refine.
+ */
+class MotionDetector
+{
+	public:
+
+		MotionDetector(float backFactor = 0.80, float threshold = 255*0.33, int scale = 1);
+		~MotionDetector();
+
+		void apply(const Mat& frame, Mat& dif);
+		void applyRegions(const Mat& frame, Mat& dif, const vector< Rect_<int> >& regions);
+		void refine(const Mat& frame, vector< Rect_<int> >& blobs, int range) const;
+		void reset();
+		int pyramidScale() const { return scale; }
+		const Mat& reference() const;
+
+	private:
+
+		void applyPyramid(const Mat& frame, Mat& dif, const vector< Rect_<int> >* regions);
+
+		float backFactor;
+		float threshold;
+		int scale;
+
+		Mat ref;
+		Mat coarse; 	//the downsampled frame, pyramid mode
+		Mat previous; 	//the reference before the last frame, pyramid mode
+};
+
+#endif // PREPROCESSING_HPP
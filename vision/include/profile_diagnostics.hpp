@@ -0,0 +1,100 @@
+#ifndef PROFILE_DIAGNOSTICS_HPP
+#define PROFILE_DIAGNOSTICS_HPP
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <diagnostic_msgs/KeyValue.h>
+#include <stdio.h>
+#include <string>
+#include <profiler.hpp>
+
+/* Publishes the stage latencies of a Profiler on /diagnostics. Header only,
+ * like frame_policy.hpp, the nodes including it depend on diagnostic_msgs.
+ */
+
+using namespace std;
+
+class ProfileReporter
+{
+	public:
+
+		ProfileReporter(const string& name = "", double period = 5.0)
+		: name(name), period(period)
+		{
+		}
+
+		/* Publishes p50/p95/p99 in ms of every stage that ran and the frame
+		 * rate, once every period seconds of wall time. The histograms are
+		 * reset, each report covers the last period.
+		 *
+		 * PARAMETERS:
+		 * 			- profiler  : the node profiler
+		 * 			- publisher : advertised on /diagnostics
+		 *
+		 * RETURN: --
+		 */
+		void publish(Profiler& profiler, const ros::Publisher& publisher)
+		{
+			if(!profiler.enabled)
+				return;
+			ros::WallTime now = ros::WallTime::now();
+			if(last_publish.isZero())
+			{
+				//The first report must not count the frames before the period
+				last_publish = now;
+				profiler.reset();
+				return;
+			}
+			double elapsed = (now - last_publish).toSec();
+			if(elapsed < period)
+				return;
+			last_publish = now;
+
+			diagnostic_msgs::DiagnosticStatus status;
+			status.name 	   = name + "/latency";
+			status.hardware_id = name;
+			status.level 	   = diagnostic_msgs::DiagnosticStatus::OK;
+
+			uint32_t counts[LatencyHistogram::BUCKETS];
+			for(int stage = 0; stage < STAGE_COUNT; ++stage)
+			{
+				profiler.take(stage, counts);
+				uint64_t total = 0;
+				for(int i = 0; i < LatencyHistogram::BUCKETS; ++i)
+					total += counts[i];
+				if(total == 0)
+					continue;
+
+				string key = stageName(stage);
+				if(stage == STAGE_FRAME)
+					addValue(status, "fps", total/elapsed);
+				addValue(status, key + "_p50_ms", LatencyHistogram::percentile(counts, 0.50)/1000);
+				addValue(status, key + "_p95_ms", LatencyHistogram::percentile(counts, 0.95)/1000);
+				addValue(status, key + "_p99_ms", LatencyHistogram::percentile(counts, 0.99)/1000);
+			}
+			status.message = status.values.empty() ? "idle" : "ok";
+
+			diagnostic_msgs::DiagnosticArray array;
+			array.header.stamp = ros::Time::now();
+			array.status.push_back(status);
+			publisher.publish(array);
+		}
+
+	private:
+
+		static void addValue(diagnostic_msgs::DiagnosticStatus& status, const string& key, double value)
+		{
+			char text[32];
+			snprintf(text, sizeof(text), "%.3f", value);
+			diagnostic_msgs::KeyValue kv;
+			kv.key 	 = key;
+			kv.value = text;
+			status.values.push_back(kv);
+		}
+
+		string name;
+		double period;
+		ros::WallTime last_publish;
+};
+
+#endif // PROFILE_DIAGNOSTICS_HPP
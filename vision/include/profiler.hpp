@@ -0,0 +1,114 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+using namespace std;
+
+/* Processing stages that are timed by the nodes */
+enum ProfileStage
+{
+	STAGE_FRAME, 		//whole callback
+	STAGE_DECODE, 		//message to Mat
+	STAGE_PREPROCESS, 	//gamma correction and CLAHE
+	STAGE_BACKGROUND, 	//background update and frame difference (one fused pass)
+	STAGE_DEPTH_FILTER, //depth cleaning and filling
+	STAGE_BLOBS, 		//detectBlobs
+	STAGE_TRACK, 		//track
+	STAGE_DEPTH, 		//calculateDepth of one box
+	STAGE_FEATURES, 	//depth, position and features of all the boxes
+	STAGE_PUBLISH, 		//results and images out
+	STAGE_COUNT
+};
+
+const char* stageName(int stage);
+
+/* Histogram of durations with logarithmic buckets, four per power of two of
+ * microseconds, so a percentile is off by at most a quarter of its value.
+ * Recording is a relaxed atomic increment and can happen from any thread.
+ */
+class LatencyHistogram
+{
+	public:
+
+		static const int BUCKETS = 96;
+
+		LatencyHistogram();
+
+		void record(int64_t ns);
+		void take(uint32_t counts[BUCKETS]);
+
+		static double percentile(const uint32_t counts[BUCKETS], double q);
+		static int bucket(int64_t ns);
+		static double bucketValue(int index);
+
+	private:
+
+		atomic<uint32_t> counts[BUCKETS];
+};
+
+/* One histogram per stage. Disabled profilers cost a branch per timer. */
+class Profiler
+{
+	public:
+
+		Profiler(bool enabled = false);
+
+		void record(int stage, int64_t ns);
+		void take(int stage, uint32_t counts[LatencyHistogram::BUCKETS]);
+		void reset();
+
+		bool enabled;
+
+	private:
+
+		LatencyHistogram stages[STAGE_COUNT];
+};
+
+/* Times a stage until it goes out of scope, next() closes the current
+ * stage and starts another one so consecutive stages need no extra scopes.
+ * A null or disabled profiler does not read the clock.
+ */
+class ScopedTimer
+{
+	public:
+
+		typedef chrono::steady_clock clock;
+
+		ScopedTimer(Profiler* profiler, int stage)
+		: profiler((profiler && profiler->enabled) ? profiler : 0), stage(stage)
+		{
+			if(this->profiler)
+				start = clock::now();
+		}
+
+		~ScopedTimer()
+		{
+			stop();
+		}
+
+		void next(int next_stage)
+		{
+			if(!profiler)
+				return;
+			clock::time_point now = clock::now();
+			if(stage >= 0)
+				profiler->record(stage, chrono::duration_cast<chrono::nanoseconds>(now - start).count());
+			stage = next_stage;
+			start = now;
+		}
+
+		void stop()
+		{
+			next(-1);
+		}
+
+	private:
+
+		Profiler* profiler;
+		int stage;
+		clock::time_point start;
+};
+
+#endif // PROFILER_HPP
@@ -0,0 +1,31 @@
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Recorded sequences, as read by ros_visual_replay and vision_benchmark. A
+ * directory holds
+ *
+ * 		- rgb_N.png 	: colour or grayscale frames
+ * 		- depth_N.png 	: 16 bit depth in mm, or depth_N.raw with raw 16 bit
+ * 						  or float depth in mm (the size is not stored)
+ *
+ * N is the frame number, zero padded or not (rgb_7.png and rgb_0007.png are
+ * both frame 7). Frames are paired by their number and either file may be
+ * missing.
+ */
+struct RecordedFrame
+{
+	long number;
+	string rgb; 	//path, empty if there is no rgb frame
+	string depth; 	//path, empty if there is no depth frame
+};
+
+bool listRecording(const string& dir, vector<RecordedFrame>& frames);
+bool readRecordedDepth(const string& path, Size raw_size, Mat& depth);
+
+#endif // RECORDING_HPP
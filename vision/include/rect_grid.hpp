@@ -0,0 +1,39 @@
+#ifndef RECT_GRID_HPP
+#define RECT_GRID_HPP
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Uniform grid over the image plane used as a spatial index for rectangles.
+ * Every rectangle is registered in all the cells it covers, so looking up the
+ * neighbours of a rectangle only touches the cells around it instead of the
+ * whole collection.
+ */
+class RectGrid
+{
+	public:
+
+		RectGrid(int width, int height, int cell_width, int cell_height);
+		~RectGrid();
+
+		void clear();
+		void insert(int index, const Rect& rect);
+		void query(const Rect& area, vector<int>& result);
+
+	private:
+
+		void cellRange(const Rect& rect, int& x0, int& y0, int& x1, int& y1) const;
+
+		int grid_cols;
+		int grid_rows;
+		int cell_width;
+		int cell_height;
+		int query_id = 0;
+
+		vector< vector<int> > cells;
+		vector<int> visited;
+};
+
+#endif // RECT_GRID_HPP
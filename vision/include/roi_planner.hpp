@@ -0,0 +1,56 @@
+#ifndef ROI_PLANNER_HPP
+#define ROI_PLANNER_HPP
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/* Parameters of the region of interest mode of the chroma stages */
+struct RoiParams
+{
+	int margin 			= 16; 	//pixels added around every track box, on top of a quarter of its size
+	int sweep_period 	= 15; 	//every so many frames the whole frame is processed
+	int stable_frames 	= 5; 	//consecutive track feedbacks before the regions are used
+	double max_age 		= 0.5; 	//seconds after which the feedback is too old to be used
+	float max_coverage 	= 0.6; 	//above this fraction of the frame the whole frame is processed
+};
+
+/* Decides frame by frame whether the per pixel chroma stages run over the
+ * whole frame or only around the tracked boxes. The boxes are fed back by the
+ * tracker with the stamp of their frame. Regions are used only while that
+ * feedback keeps arriving, and a whole frame sweep every sweep_period frames
+ * catches the people that enter outside them.
+ *
+ * The regions are the grown boxes snapped outwards to a tile grid (the CLAHE
+ * tiles, see ImagePreprocessor::tileSize) and merged until none overlap, so
+ * every pixel is processed once.
+ */
+class RoiPlanner
+{
+	public:
+
+		RoiPlanner(const RoiParams& params = RoiParams());
+		~RoiPlanner();
+
+		void setParams(const RoiParams& params);
+		void setTracks(const vector< Rect_<int> >& boxes, double stamp);
+		void reset();
+		bool plan(const Size& frame, const Size& tile, double stamp, vector< Rect_<int> >& regions);
+
+		//Share of the frame processed, over the frames planned so far
+		double occupancy() const;
+
+	private:
+
+		RoiParams params;
+		vector< Rect_<int> > tracks;
+		double tracks_stamp = 0.0;
+		int feedbacks 	= 0;
+		int since_sweep = 0;
+
+		double processed_area = 0.0;
+		double frame_area 	  = 0.0;
+};
+
+#endif // ROI_PLANNER_HPP
@@ -13,6 +13,9 @@
 #include <opencv2/video/background_segm.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <depth_integral.hpp>
+#include <people.hpp>
+#include <profiler.hpp>
 
 
 using namespace std;
@@ -20,50 +23,29 @@ using namespace cv;
 	
 	
 	
-	struct Position 
-	{
-		float x = 0.0;
-		float y = 0.0;
-		float z = 0.0;
-		float area 	    = 0.0;
-		float ratio     = 0.0;
-		float y_norm    = 0.0;
-		float distance  = 0.0;
-		float depth_std = 0.0;
-		
-		float x_diff        = 0.0;
-		float y_diff        = 0.0;
-		float z_diff        = 0.0;
-		float z_diff_norm   = 0.0;
-		float area_diff     = 0.0;
-		float y_norm_diff	= 0.0;
-		float ratio_diff    = 0.0;
-		float distance_diff = 0.0;
-		
-		float x_delta   = 0.0;
-		float y_delta   = 0.0;
-		
-	};
-	
-	struct People 
-	{
-		vector< Rect_<int> > tracked_boxes;
-		vector< float > tracked_rankings;
-		vector< Position > tracked_pos;
-	};
 		
 	//Detection and tracking of blobs
 	void detectBlobs(const Mat& src, vector< Rect_<int> >& colour_areas, int range, int subsampling, bool detect_people);
-	void track(vector< Rect_<int> >& current, People& collection, int width, int height, int rank = 3, int max_rank = 30);
+	void track(vector< Rect_<int> >& current, People& collection, int width, int height, int rank = 3, int max_rank = 30, const MotionParams* motion = NULL);
 	
 	//Depth estimation functions
-	float  calculateDepth(const Mat& src, Position& pos);
+	enum DepthEstimator { DEPTH_KMEANS, DEPTH_HISTOGRAM };
+	
+	//Definition of the depth_std feature: mean absolute distance of every
+	//pixel of the box from its depth (the classifier was trained on it), or
+	//root mean square distance of its valid pixels only, from the integrals
+	enum DepthDeviation { DEPTH_STD_MEAN_ABS, DEPTH_STD_VALID_RMS };
+	
+	float  calculateDepth(const Mat& src, Position& pos, DepthEstimator estimator = DEPTH_KMEANS);
+	float  kmeansDepth(const Mat& src, const Position& pos);
+	float  histogramDepth(const Mat& src, const Position& pos);
 	double minDepth(vector<double> vec, int number);
 	double centerDepth(const Mat& src, int number);
 	double combineDepth(double saveMin, double saveCenter, double saveCluster, double min_depth = 0.0, double max_depth = 6.0);
 		
 	//Position estimation
 	void calculatePosition(Rect& rect, Position& pos, int width = 640, int height = 480, int Hfield = 58, int Vfield = 45);
+	void calculateFeatures(People& collection, const Mat& depth, const DepthIntegral& integral, DepthEstimator estimator = DEPTH_KMEANS, DepthDeviation deviation = DEPTH_STD_MEAN_ABS, int max_threads = 1, Profiler* profiler = NULL);
 	
 	//Region growing algorithms
 	void upVerticalFill(Mat& src, float threshold, bool flag);
@@ -76,13 +58,16 @@ using namespace cv;
 	void estimateForeground(Mat& src1, Mat& src2, Mat& dst);
 	
 	void frameDif(const Mat& src1, const Mat& src2, Mat& dst, float thresh);
+	void updateBackground(const Mat& cur, Mat& ref, Mat& dst, float backFactor, float thresh);
 		
 	//helper functions
 	int threshold(Mat& src, Mat& dst, int thresh);
 	void gammaCorrection(const Mat& src, float factor);
+	void gammaLut(Mat& lut, float factor);
 	void fixRects(vector< Rect_<int> >& rects, int screenW);
-	void depthToGray(Mat& src, Mat& dst, float min_depth, float max_depth);
-	void grayToDepth(Mat& src, Mat& dst, float max_depth);
+	void depthToGray(const Mat& src, Mat& dst, float min_depth, float max_depth);
+	void grayToDepth(const Mat& src, Mat& dst, float max_depth);
+	void cleanDepth(const Mat& src, Mat& gray, Mat& dst, float min_depth, float max_depth);
 
 
 #endif
@@ -0,0 +1,259 @@
+#include <vision.hpp>
+#include <rect_grid.hpp>
+
+/* A horizontal run of non-zero samples in a row. Samples closer than
+ * range pixels belong to the same run because their range x range
+ * rectangles would overlap.
+ */
+struct BlobRun
+{
+	int x0;
+	int x1;
+	int y;
+	int label;
+};
+
+/* Union-find lookup with path halving */
+static int findLabel(vector<int>& parent, int label)
+{
+	while(parent[label] != label)
+	{
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+static void unionLabels(vector<int>& parent, int a, int b)
+{
+	a = findLabel(parent, a);
+	b = findLabel(parent, b);
+	if(a == b)
+		return;
+	//Keep the oldest label as root so the output follows the scan order
+	if(a < b)
+		parent[b] = a;
+	else
+		parent[a] = b;
+}
+
+/* The proximity rules of the merging phase: two rectangles are fused if
+ * they intersect, or if they are vertically closer than rows/20 and either
+ * overlap horizontally or are closer than cols/50 without their union
+ * growing more than twice the biggest of them.
+ */
+static bool mergeable(const Rect& removal, const Rect& rect, int rows, int cols)
+{
+	Rect all 		  = removal | rect;
+	Rect intersection = removal & rect;
+	int threshold 	  = intersection.area();
+	if(threshold == 0)
+	{
+		int y_distance = 0;
+		if (removal.y < rect.y)
+			y_distance = rect.y - (removal.y + removal.height);
+		else
+			y_distance = removal.y - (rect.y + rect.height);
+		if(y_distance < rows/20)
+		{
+			Rect aligned = removal;
+			aligned.y 	 = rect.y;
+			intersection = aligned & rect;
+			threshold 	 = intersection.area();
+			if(threshold == 0)
+			{
+				int x_distance = cols;
+				if (removal.x < rect.x)
+					x_distance = rect.x - (removal.x + removal.width);
+				else
+					x_distance = removal.x - (rect.x + rect.width);
+
+				float area_thres = max(removal.area(), rect.area());
+				if((x_distance < cols/50) && (all.area() < 2*area_thres))
+					threshold = 1;
+			}
+		}
+	}
+	return threshold > 0;
+}
+
+/* Detects non-black rectangle areas in a black image. This
+ * to produce ROIS(Regions of interest) for further processing.
+ *
+ * The non-zero samples are grouped in a single pass into horizontal runs that
+ * are labelled with union-find, two runs share a label when the range x range
+ * rectangles of their pixels would overlap. The bounding boxes of the labels
+ * are then fused with the proximity rules through a spatial grid, so the cost
+ * depends on the number of runs and not on pixels x rectangles.
+ *
+ * PARAMETERS:
+ * 			- src		   : the Mat object that holds the image
+ * 			- colour_areas : the rectangles produced
+ * 			- range		   : the starting dimension of each rectangle, at least 1
+ * 			- subsampling  : number of pixels to skip at each iteration
+ * 			- detect_people: filter boxes(unfinished)
+ *
+ * RETURN --
+ */
+void detectBlobs(const Mat& src, vector< Rect_<int> >& colour_areas, int range, int subsampling, bool detect_people)
+{
+	int cols     		   = src.cols;
+	int rows 	 		   = src.rows;
+	int channels 		   = src.channels();
+	int step 			   = max(subsampling, 1);
+	range 				   = max(range, 1); 	//the run cursors and rectangles need one pixel
+
+	vector<BlobRun> runs;
+	vector<int> parent;
+	vector<int> row_start(rows + 1, 0);
+	vector<int> cursor(range, 0);
+
+	//Labelling phase, a pixel whose rectangle would be out of bounds is skipped
+	for(int j = 0; j < rows; ++j)
+	{
+		row_start[j] = runs.size();
+		if(j + range >= rows)
+			continue;
+
+		const uchar *dif = src.ptr<uchar>(j);
+		for(int k = 1; k < range && k <= j; ++k)
+			cursor[k] = row_start[j - k];
+
+		int i = 0;
+		while(i + range < cols)
+		{
+			if(dif[i*channels] == 0)
+			{
+				i += step;
+				continue;
+			}
+
+			//Extend the run while the next non-zero sample is closer than range
+			BlobRun run;
+			run.x0 = i;
+			run.x1 = i;
+			run.y  = j;
+			for(i += step; i + range < cols && i < run.x1 + range; i += step)
+				if(dif[i*channels] != 0)
+					run.x1 = i;
+
+			run.label = parent.size();
+			parent.push_back(run.label);
+
+			//Connect with the runs of the previous range - 1 rows, the runs of each
+			//row are sorted by x so a cursor per row is enough
+			for(int k = 1; k < range && k <= j; ++k)
+			{
+				int end = row_start[j - k + 1];
+				int& c  = cursor[k];
+				while(c < end && runs[c].x1 + range <= run.x0)
+					++c;
+				for(int q = c; q < end && runs[q].x0 < run.x1 + range; ++q)
+					unionLabels(parent, run.label, runs[q].label);
+			}
+			runs.push_back(run);
+		}
+	}
+	row_start[rows] = runs.size();
+
+	//Bounding box of every label, the boxes already in colour_areas take part in
+	//the merging phase as well
+	vector< Rect_<int> > boxes(colour_areas);
+	vector<int> box_of(parent.size(), -1);
+	for(int r = 0; r < runs.size(); ++r)
+	{
+		const BlobRun& run = runs[r];
+		Rect_<int> rect(run.x0, run.y, run.x1 - run.x0 + range, range);
+		int root = findLabel(parent, run.label);
+		if(box_of[root] < 0)
+		{
+			box_of[root] = boxes.size();
+			boxes.push_back(rect);
+		}
+		else
+			boxes[box_of[root]] |= rect;
+	}
+
+	//In this phase we loop through all the produced rectangles and again try to merge those whose
+	//intersection is above a certain threshold. Candidates come from a grid so every box is only
+	//compared against its neighbourhood, a box that grew is registered again and re-examined.
+	int margin_x = cols/50 + 1;
+	int margin_y = rows/20 + 1;
+	RectGrid grid(cols, rows, max(cols/16, range), max(rows/16, range));
+	vector<bool> alive(boxes.size(), true);
+	vector<int> candidates;
+	bool merged = !boxes.empty();
+	while(merged)
+	{
+		merged = false;
+		grid.clear();
+		for(int a = 0; a < boxes.size(); ++a)
+			if(alive[a])
+				grid.insert(a, boxes[a]);
+
+		for(int a = 0; a < boxes.size(); ++a)
+		{
+			bool grown = alive[a];
+			while(grown)
+			{
+				grown = false;
+				Rect_<int> box = boxes[a];
+				grid.query(Rect(box.x - margin_x, box.y - margin_y, box.width + 2*margin_x, box.height + 2*margin_y), candidates);
+				for(int k = 0; k < candidates.size(); ++k)
+				{
+					int b = candidates[k];
+					if(b == a || !alive[b])
+						continue;
+					if(mergeable(boxes[a], boxes[b], rows, cols))
+					{
+						boxes[a] |= boxes[b];
+						alive[b] = false;
+						grown 	 = true;
+						merged 	 = true;
+					}
+				}
+				if(grown)
+					grid.insert(a, boxes[a]);
+			}
+		}
+	}
+
+	colour_areas.clear();
+	for(int a = 0; a < boxes.size(); ++a)
+		if(alive[a])
+			colour_areas.push_back(boxes[a]);
+
+	vector< Rect_<int> >::iterator it;
+	//Filter out erroneous areas (dimensions < 0) that sometimes occur
+	for(it = colour_areas.begin(); it < colour_areas.end();)
+	{
+		Rect_<int> rect = *it;
+		float x  	 = rect.x;
+		float y 	 = rect.y;
+		float width  = rect.width;
+		float height = rect.height;
+		if((x < 0) || (y < 0) || (height <= 0) || (width <= 0))
+			it = colour_areas.erase(it);
+		else
+			it++;
+	}
+
+	//Filter out areas whose ratio cannot belong to a human
+	if(detect_people)
+	{
+
+		vector< Rect_<int> >::iterator it;
+		for(it = colour_areas.begin(); it < colour_areas.end();)
+		{
+			Rect_<int> rect = *it;
+			float width  = rect.width;
+			float height = rect.height;
+			float area   = rect.area();
+			float ratio  = width/height;
+			if((ratio < 0.25) || (ratio > 1.5) || (area < cols*rows*0.02))
+				it = colour_areas.erase(it);
+			else
+				it++;
+		}
+	}
+}
@@ -0,0 +1,148 @@
+#include <depth_integral.hpp>
+#include <math.h>
+
+DepthIntegral::DepthIntegral()
+{
+}
+
+DepthIntegral::~DepthIntegral()
+{
+}
+
+/* Builds the integral images of a depth frame in one pass, invalid
+ * (zero, NaN or infinite) depths do not contribute to any of them
+ * 
+ * PARAMETERS:
+ * 			- depth : depth frame in CV_32FC1 (read only)
+ * 
+ * RETURN: --
+ */
+void DepthIntegral::compute(const Mat& depth)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	int rows = depth.rows;
+	int cols = depth.cols;
+	sum.create(rows + 1, cols + 1, CV_64F);
+	sqsum.create(rows + 1, cols + 1, CV_64F);
+	count.create(rows + 1, cols + 1, CV_32S);
+
+	double* s0  = sum.ptr<double>(0);
+	double* sq0 = sqsum.ptr<double>(0);
+	int* n0 	= count.ptr<int>(0);
+	for(int x = 0; x <= cols; ++x)
+	{
+		s0[x]  = 0.0;
+		sq0[x] = 0.0;
+		n0[x]  = 0;
+	}
+
+	for(int y = 0; y < rows; ++y)
+	{
+		const float* src  = depth.ptr<float>(y);
+		const double* ps  = sum.ptr<double>(y);
+		const double* psq = sqsum.ptr<double>(y);
+		const int* pn 	  = count.ptr<int>(y);
+		double* s  = sum.ptr<double>(y + 1);
+		double* sq = sqsum.ptr<double>(y + 1);
+		int* n 	   = count.ptr<int>(y + 1);
+
+		double row_s  = 0.0;
+		double row_sq = 0.0;
+		int row_n 	  = 0;
+		s[0]  = 0.0;
+		sq[0] = 0.0;
+		n[0]  = 0;
+		for(int x = 0; x < cols; ++x)
+		{
+			double value = src[x];
+			if(value > 0 && isfinite(value))
+			{
+				row_s  += value;
+				row_sq += value*value;
+				++row_n;
+			}
+			s[x + 1]  = ps[x + 1]  + row_s;
+			sq[x + 1] = psq[x + 1] + row_sq;
+			n[x + 1]  = pn[x + 1]  + row_n;
+		}
+	}
+	ready = true;
+}
+
+/* Forgets the current frame, the buffers are kept for the next one */
+void DepthIntegral::clear()
+{
+	ready = false;
+}
+
+bool DepthIntegral::empty() const
+{
+	return !ready;
+}
+
+/* Mean, standard deviation and ratio of valid pixels of a rectangle,
+ * clipped to the frame
+ * 
+ * PARAMETERS:
+ * 			- rect : the area
+ * 
+ * RETURN:
+ * 			- the statistics, all zero if the area has no valid pixel
+ */
+DepthStats DepthIntegral::stats(const Rect& rect) const
+{
+	DepthStats result;
+	Rect r = clip(rect);
+	if(r.area() <= 0)
+		return result;
+
+	double s, sq;
+	area(r, s, sq, result.valid);
+	result.valid_ratio = (double)result.valid/r.area();
+	if(result.valid == 0)
+		return result;
+
+	result.mean = s/result.valid;
+	result.std  = sqrt(max(sq/result.valid - result.mean*result.mean, 0.0));
+	return result;
+}
+
+/* Root mean square distance of the valid depths of a rectangle from z
+ * 
+ * PARAMETERS:
+ * 			- rect : the area
+ * 			- z    : the reference depth
+ * 
+ * RETURN:
+ * 			- the deviation, 0 if the area has no valid pixel
+ */
+double DepthIntegral::deviation(const Rect& rect, double z) const
+{
+	Rect r = clip(rect);
+	if(r.area() <= 0)
+		return 0.0;
+
+	double s, sq;
+	int n;
+	area(r, s, sq, n);
+	if(n == 0)
+		return 0.0;
+	//E[(x - z)^2] = E[x^2] - 2zE[x] + z^2
+	return sqrt(max(sq/n - 2*z*s/n + z*z, 0.0));
+}
+
+Rect DepthIntegral::clip(const Rect& rect) const
+{
+	if(empty())
+		return Rect();
+	return rect & Rect(0, 0, count.cols - 1, count.rows - 1);
+}
+
+/* Sums of a (clipped) rectangle from the four corners of the integrals */
+void DepthIntegral::area(const Rect& r, double& s, double& sq, int& n) const
+{
+	int x0 = r.x, y0 = r.y, x1 = r.x + r.width, y1 = r.y + r.height;
+	s  = sum.at<double>(y1, x1) - sum.at<double>(y0, x1) - sum.at<double>(y1, x0) + sum.at<double>(y0, x0);
+	sq = sqsum.at<double>(y1, x1) - sqsum.at<double>(y0, x1) - sqsum.at<double>(y1, x0) + sqsum.at<double>(y0, x0);
+	n  = count.at<int>(y1, x1) - count.at<int>(y0, x1) - count.at<int>(y1, x0) + count.at<int>(y0, x0);
+}
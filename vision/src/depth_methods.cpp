@@ -1,39 +1,144 @@
 #include <vision.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-/*Converts a grayscale Mat to a depth Mat by using the maximum depth value
+/* Row kernel of depthToGray for 32FC1 depths in mm. The depth is divided
+ * by the range before the 255 scale, in this order, so in range values give
+ * the gray levels of 255*((depth - min_depth)/range) exactly. Values below
+ * min_depth, NaN included, give 0 and values above max_depth give 255.
+ */
+static void depthToGrayRow(const float* src, uchar* dst, int n, float min_depth, float range)
+{
+	int x = 0;
+#if defined(__SSE2__)
+	const __m128 lo 	= _mm_set1_ps(min_depth);
+	const __m128 r 		= _mm_set1_ps(range);
+	const __m128 zero 	= _mm_setzero_ps();
+	const __m128 top 	= _mm_set1_ps(255.0f);
+	for(; x <= n - 16; x += 16)
+	{
+		__m128i q[4];
+		for(int h = 0; h < 4; ++h)
+		{
+			//max returns its second operand for NaN, so NaN becomes 0
+			__m128 v = _mm_mul_ps(top, _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(src + x + 4*h), lo), r));
+			q[h] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), top));
+		}
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+	}
+#endif
+	for(; x < n; ++x)
+	{
+		float v = 255*((src[x] - min_depth)/range);
+		if(!(v > 0.0f))
+			dst[x] = 0;
+		else if(v >= 255.0f)
+			dst[x] = 255;
+		else
+			dst[x] = (uchar)v;
+	}
+}
+
+/* Row kernel of depthToGray for native 16UC1 depths in mm, integer only.
+ * The depth is clamped to [lo, lo + range] and the gray level is the exact
+ * floor(255*v/range): k = floor(255*65536/range) estimates it at most one
+ * below, the remainder of the estimate corrects it.
+ */
+static void depthToGrayRow(const ushort* src, uchar* dst, int n, int lo, int range, unsigned k)
+{
+	int x = 0;
+#if defined(__SSE2__)
+	//k and the remainders have to fit the 16 bit lanes, other ranges take the scalar path
+	if(range > 255 && range < 0x8000)
+	{
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i low   = _mm_set1_epi16((short)lo);
+		const __m128i high  = _mm_set1_epi16((short)range);
+		const __m128i below = _mm_set1_epi16((short)(range - 1));
+		const __m128i mul   = _mm_set1_epi16((short)k);
+		const __m128i full  = _mm_set1_epi16(255);
+		for(; x <= n - 16; x += 16)
+		{
+			__m128i q[2];
+			for(int h = 0; h < 2; ++h)
+			{
+				//Saturating subtractions clamp below lo and above lo + range
+				__m128i v = _mm_subs_epu16(_mm_loadu_si128((const __m128i*)(src + x + 8*h)), low);
+				v = _mm_sub_epi16(v, _mm_subs_epu16(v, high));
+				
+				//The remainder is below 2*range, so it is exact modulo 65536
+				q[h] = _mm_mulhi_epu16(v, mul);
+				__m128i r = _mm_sub_epi16(_mm_mullo_epi16(v, full), _mm_mullo_epi16(q[h], high));
+				__m128i fits = _mm_cmpeq_epi16(_mm_subs_epu16(r, below), zero);
+				q[h] = _mm_sub_epi16(q[h], _mm_andnot_si128(fits, _mm_set1_epi16(-1)));
+			}
+			_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(q[0], q[1]));
+		}
+	}
+#endif
+	for(; x < n; ++x)
+	{
+		unsigned v = min(max((int)src[x] - lo, 0), range);
+		unsigned q = (v*k) >> 16;
+		if(255*v - q*range >= (unsigned)range)
+			++q;
+		dst[x] = (uchar)q;
+	}
+}
+
+/*Converts a grayscale Mat to a depth Mat by using the maximum depth value.
+ * The 256 possible depths are computed once per call, so the conversion is
+ * a table lookup per pixel.
  * 
  * PARAMETERS:
- * 			-Mat depth
- * 			-Mat with the graysclae result
- * 			-float minimum depth
+ * 			-Mat grayscale
+ * 			-Mat with the depth result (32FC1)
  * 			-float maximum depth
  * 
  * RETURN: --
  */
-void grayToDepth(Mat& src, Mat& dst, float max_depth)
+void grayToDepth(const Mat& src, Mat& dst, float max_depth)
 {
-	Mat temp_img(src.rows, src.cols, CV_32FC1);
+	float lut[256];
+	for(int g = 0; g < 256; ++g)
+		lut[g] = (max_depth*(float(g)/(255.0)));
+	
+	//Write straight into dst unless it shares its buffer with src, the
+	//element size changes so an aliased dst needs a new buffer
+	bool aliased = (src.data == dst.data);
+	Mat temp_img;
+	if(aliased)
+		temp_img.create(src.rows, src.cols, CV_32FC1);
+	else
+	{
+		dst.create(src.rows, src.cols, CV_32FC1);
+		temp_img = dst;
+	}
 	int cols = src.cols;
 	int rows = src.rows;
-	if(src.isContinuous())
+	if(src.isContinuous() && temp_img.isContinuous())
 	{
 	    cols *= rows;
 	    rows = 1;
 	}
 	for(int i = 0; i < rows; i++)
 	{
-		uchar* cur = src.ptr<uchar>(i);
+		const uchar* cur = src.ptr<uchar>(i);
 		float* Ii = temp_img.ptr<float>(i);
 		for(int j = 0; j < cols; j++)
-		{   
-			Ii[j] = (max_depth*(float(cur[j])/(255.0)));
-		}   
+			Ii[j] = lut[cur[j]];
 	}
-	dst = temp_img.clone();
+	if(aliased)
+		dst = temp_img;
 	
 }
 
-/*Converts a depth Mat to a grayscale one by using the min and maximum depth values
+/*Converts a depth Mat to a grayscale one by using the min and maximum depth
+ * values. The depth is 32FC1 or native 16UC1, both in mm, so a 16 bit sensor
+ * image needs no float decode. Depths below the range, missing (0 or NaN)
+ * included, give 0 and depths above it give 255. With 16UC1 the range is
+ * rounded to whole mm.
  * 
  * PARAMETERS:
  * 			-Mat depth
@@ -43,41 +148,113 @@ void grayToDepth(Mat& src, Mat& dst, float max_depth)
  * 
  * RETURN: --
  */
-void depthToGray(Mat& src, Mat& dst, float min_depth, float max_depth)
+void depthToGray(const Mat& src, Mat& dst, float min_depth, float max_depth)
 {
+	CV_Assert((src.type() == CV_32FC1 || src.type() == CV_16UC1) && max_depth > min_depth);
 	
-	Mat temp_img(src.rows, src.cols, CV_8UC1);
+	//Write straight into dst unless it shares its buffer with src
+	bool aliased = (src.data == dst.data);
+	Mat temp_img;
+	if(aliased)
+		temp_img.create(src.rows, src.cols, CV_8UC1);
+	else
+	{
+		dst.create(src.rows, src.cols, CV_8UC1);
+		temp_img = dst;
+	}
 	int cols = src.cols;
 	int rows = src.rows;
-	if(src.isContinuous())
+	if(src.isContinuous() && temp_img.isContinuous())
 	{
 	    cols *= rows;
 	    rows = 1;
 	}
-	for(int i = 0; i < rows; i++)
+	if(src.type() == CV_32FC1)
 	{
-		float* cur = src.ptr<float>(i);
-		uchar* Ii = temp_img.ptr<uchar>(i);
-		for(int j = 0; j < cols; j++)
-		{   
-			Ii[j] = (255*((cur[j] - min_depth)/(max_depth - min_depth)));
-		}   
+		float range = max_depth - min_depth;
+		for(int i = 0; i < rows; i++)
+			depthToGrayRow(src.ptr<float>(i), temp_img.ptr<uchar>(i), cols, min_depth, range);
+	}
+	else
+	{
+		int lo 	   = min(max(cvRound(min_depth), 0), 0xFFFF);
+		int range  = max(min(cvRound(max_depth), 0xFFFF) - lo, 1);
+		unsigned k = (255u << 16)/range;
+		for(int i = 0; i < rows; i++)
+			depthToGrayRow(src.ptr<ushort>(i), temp_img.ptr<uchar>(i), cols, lo, range, k);
 	}
-	dst = temp_img.clone();
+	if(aliased)
+		dst = temp_img;
+	
+}
+
+/* Depth preprocessing: converts the depth to grayscale, closes small gaps and
+ * fills the areas that have no value because of sensor noise or surface
+ * reflectivity, then converts back to depth values
+ * 
+ * PARAMETERS:
+ * 			-Mat depth, 32FC1 or 16UC1 in mm
+ * 			-Mat to store the corrected grayscale image
+ * 			-Mat to store the corrected depth
+ * 			-float minimum depth
+ * 			-float maximum depth
+ * 
+ * RETURN: --
+ */
+void cleanDepth(const Mat& src, Mat& gray, Mat& dst, float min_depth, float max_depth)
+{
+	int morph_size = 2;
+	
+	//Converting depth values to 0-255
+	depthToGray(src, gray, min_depth, max_depth);
+	
+	Mat element = getStructuringElement(MORPH_RECT, Size( 2*morph_size + 1, 2*morph_size+1 ), Point( morph_size, morph_size ) );
+	morphologyEx(gray, gray, MORPH_CLOSE, element);
 	
+	rectFill(gray, 0.3, 2);
+	upVerticalFill(gray, 0.3, true);
+	
+	//Converting chroma values to meters
+	grayToDepth(gray, dst, max_depth);
 }
 
-/* Calculates the depth of the closest object in the specified Mat by using clustering
+#define DEPTH_HIST_BINS  256 	/**< Bins of the depth histogram */
+#define DEPTH_HIST_WIDTH 50.0 	/**< Width of a histogram bin in mm, the bins cover 12.8m */
+#define DEPTH_NEAR 		 1000.0 /**< Depths closer than this are rejected */
+#define DEPTH_JUMP 		 1000.0 /**< Maximum change from the previous depth of the box */
+#define DEPTH_KMEANS_SEED 0x12345678 /**< Seed of the kmeans++ centers of every box */
+
+/* Calculates the depth of the closest object in the specified Mat
  * 
  * PARAMETERS:
  * 		-Mat
- * 		-number of values to calculate
+ * 		-Position of the box, z holds the previous depth
+ * 		-estimator to use
  * 		
  * RETURN:   
- * 		-Double holding the min cluster median value
+ * 		-Float holding the depth, 0 if no candidate was accepted
  * 
  */
-float calculateDepth(const Mat& src, Position& pos)
+float calculateDepth(const Mat& src, Position& pos, DepthEstimator estimator)
+{
+	if(estimator == DEPTH_KMEANS)
+		return kmeansDepth(src, pos);
+	return histogramDepth(src, pos);
+}
+
+/* Depth by clustering the central region of the Mat with kmeans, the
+ * most populated cluster that is far enough and close to the previous
+ * depth wins
+ * 
+ * PARAMETERS:
+ * 		-Mat
+ * 		-Position of the box, z holds the previous depth
+ * 		
+ * RETURN:   
+ * 		-Float holding the cluster center, 0 if none was accepted
+ * 
+ */
+float kmeansDepth(const Mat& src, const Position& pos)
 {
 	Mat labels;
 	Mat centers;
@@ -85,21 +262,31 @@ float calculateDepth(const Mat& src, Position& pos)
 	int attempts = 3;
 	int j = 0;
 	float depth= 0.0;
-	float dif = 1000.0;
+	float dif = DEPTH_JUMP;
 	float temp_depth = 0.0;
 	int occur[clusters];
 	int row_start = src.rows/4;
 	int col_start = src.cols/4;
 	
+	if(4*row_start*col_start < clusters)
+		return depth;
+	
+	fill(occur, occur + clusters, 0);
 	Mat samples(4*row_start * col_start, 1, CV_32F);
 	for( int y = 0; y < 2*row_start; ++y)
 		for( int x = 0; x < 2*col_start; ++x)
 			samples.at<float>(y + 2*x*row_start) = src.at<float>(y + row_start ,x + col_start);
+	//kmeans++ draws from the RNG of the calling thread, seeding it for every
+	//box keeps the depth independent of the feature threads and their order
+	RNG& rng = theRNG();
+	uint64 state = rng.state;
+	rng.state = DEPTH_KMEANS_SEED;
 	double c = kmeans(samples, clusters, labels, TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 1000, 10), attempts, KMEANS_PP_CENTERS, centers);
+	rng.state = state;
 	for(int j = 0; j < labels.rows; ++j)
 		++occur[labels.at<int>(j)];
 	
-	while(j < clusters && (temp_depth < 1000.0 || dif > 1000))
+	while(j < clusters && (temp_depth < DEPTH_NEAR || dif > DEPTH_JUMP))
 	{
 		auto it = max_element(occur, occur + clusters);
 		int index = distance(occur, it);
@@ -115,50 +302,69 @@ float calculateDepth(const Mat& src, Position& pos)
 		depth = temp_depth;
 		
 	return depth;
+}
+
+/* Depth from the modes of a quantized histogram of the central region of
+ * the Mat. Same selection as the kmeans path, the strongest peak that is far
+ * enough and close to the previous depth wins, but the cost is one pass over
+ * the pixels plus a fixed number of bins. Invalid (zero, NaN or infinite)
+ * depths are skipped. The depth of a peak is the mean of the samples in its bins, so it
+ * is not limited to the bin resolution.
+ * 
+ * PARAMETERS:
+ * 		-Mat
+ * 		-Position of the box, z holds the previous depth
+ * 		
+ * RETURN:   
+ * 		-Float holding the peak depth, 0 if none was accepted
+ * 
+ */
+float histogramDepth(const Mat& src, const Position& pos)
+{
+	int count[DEPTH_HIST_BINS + 2] = {0};
+	float sum[DEPTH_HIST_BINS + 2] = {0};
+	int row_start = src.rows/4;
+	int col_start = src.cols/4;
 	
-	/*
-	// Preprocessing step to discard null or unwanted depth values 
-	// and convert Mat to vector
-	for(int i = 0; i < rows; i++)
+	//Bins are shifted by one so every bin has two neighbours
+	for(int y = row_start; y < 3*row_start; ++y)
 	{
-		float* cur = src.ptr<float>(i);
-		for(int j = 0; j < cols; j++)
+		const float* cur = src.ptr<float>(y);
+		for(int x = col_start; x < 3*col_start; ++x)
 		{
-			vec.push_back(cur[j]);
+			float value = cur[x];
+			if(!(value > 0) || !isfinite(value))
+				continue;
+			//Clamped before the cast, far depths would overflow the int
+			int bin = (int)min(value*float(1.0/DEPTH_HIST_WIDTH), DEPTH_HIST_BINS - 1.0f) + 1;
+			++count[bin];
+			sum[bin] += value;
 		}
-		
 	}
-	// average of minimum vector elements 
-	saveMin = minDepth(vec, 20);
-
-	// find the depth of the mat center area 
-	saveCenter = centerDepth(src, 10);
-	
 	
+	//Smoothed histogram and its local maxima
+	int smooth[DEPTH_HIST_BINS + 2] = {0};
+	for(int b = 1; b <= DEPTH_HIST_BINS; ++b)
+		smooth[b] = count[b - 1] + 2*count[b] + count[b + 1];
 	
+	vector< pair<int, int> > peaks;
+	for(int b = 1; b <= DEPTH_HIST_BINS; ++b)
+		if(smooth[b] > 0 && smooth[b] >= smooth[b - 1] && smooth[b] > smooth[b + 1])
+			peaks.push_back(make_pair(-smooth[b], b));
+	sort(peaks.begin(), peaks.end());
 	
-	//~ int id = -1;
-	//~ double result = FLT_MAX;
-	//~ 
-	//~ for(int i = 0; i < rep.c.rows() - 1; i++)
-	//~ {
-		//~ double temp = std::min(result, rep.c[i + 1][0]);
-		//~ if(temp > 0)
-		//~ {
-			//~ id = i;
-			//~ result = temp;
-		//~ }
-	//~ }
-	//~ saveCluster = result;
-	
-	//combine the results of the 2 closest
-	depthCombined = combineDepth(saveMin, saveCenter, median, 0, max_depth);
-	
-
-	//~ printf("%s %2.3f\n","Depth combined:  " ,depthCombined);
-	return depthCombined;
-	*/
-		
+	for(int p = 0; p < peaks.size(); ++p)
+	{
+		int b 		= peaks[p].second;
+		int samples = count[b - 1] + count[b] + count[b + 1];
+		float depth = (sum[b - 1] + sum[b] + sum[b + 1])/samples;
+		if(depth < DEPTH_NEAR)
+			continue;
+		if(pos.z > 0 && abs(pos.z - depth) > DEPTH_JUMP)
+			continue;
+		return depth;
+	}
+	return 0.0;
 }
 
 /* Finds an average of the minimum 
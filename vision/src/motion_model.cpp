@@ -0,0 +1,126 @@
+#include <motion_model.hpp>
+#include <math.h>
+
+#define MOTION_INIT_VELOCITY 100.0 	/**< Variance of the unknown velocity of a new box, (px/frame)^2 */
+
+/* Predicts one axis, F = [1 1; 0 1] and white acceleration noise q */
+static void predictAxis(float& c, float v, float& pcc, float& pcv, float& pvv, float q)
+{
+	c   += v;
+	pcc += 2*pcv + pvv + q/4;
+	pcv += pvv + q/2;
+	pvv += q;
+}
+
+/* Corrects one axis with a measured position z of variance r */
+static void updateAxis(float& c, float& v, float& pcc, float& pcv, float& pvv, float z, float r)
+{
+	float s  = pcc + r;
+	float k0 = pcc/s;
+	float k1 = pcv/s;
+	float y  = z - c;
+	c 	+= k0*y;
+	v 	+= k1*y;
+	pvv -= k1*pcv;
+	pcv -= k0*pcv;
+	pcc -= k0*pcc;
+}
+
+/* Corrects a random walk scalar with a measurement z of variance r */
+static void updateScalar(float& value, float& p, float z, float r)
+{
+	float k = p/(p + r);
+	value += k*(z - value);
+	p 	  -= k*p;
+}
+
+/* Starts the filter at a detected box, with unknown velocity
+ *
+ * PARAMETERS:
+ * 			- box 	 : the detected box
+ * 			- params : noise of the model
+ *
+ * RETURN: --
+ */
+void BoxFilter::init(const Rect_<int>& box, const MotionParams& params)
+{
+	float r = params.measurement_noise*params.measurement_noise;
+	cx  = box.x + box.width/2.0;
+	cy  = box.y + box.height/2.0;
+	vx  = vy  = 0.0;
+	pxx = pyy = r;
+	pxv = pyv = 0.0;
+	pvvx = pvvy = MOTION_INIT_VELOCITY;
+	w 	= box.width;
+	h 	= box.height;
+	pw 	= ph = r;
+	age = 0;
+}
+
+/* Moves the box one frame ahead
+ *
+ * PARAMETERS:
+ * 			- params : noise of the model
+ *
+ * RETURN: --
+ */
+void BoxFilter::predict(const MotionParams& params)
+{
+	float q = params.process_noise*params.process_noise;
+	predictAxis(cx, vx, pxx, pxv, pvvx, q);
+	predictAxis(cy, vy, pyy, pyv, pvvy, q);
+	pw += params.size_noise*params.size_noise;
+	ph += params.size_noise*params.size_noise;
+}
+
+/* Corrects the prediction with the box detected in this frame
+ *
+ * PARAMETERS:
+ * 			- box 	 : the detected box
+ * 			- params : noise of the model
+ *
+ * RETURN: --
+ */
+void BoxFilter::update(const Rect_<int>& box, const MotionParams& params)
+{
+	float r = params.measurement_noise*params.measurement_noise;
+	updateAxis(cx, vx, pxx, pxv, pvvx, box.x + box.width/2.0, r);
+	updateAxis(cy, vy, pyy, pyv, pvvy, box.y + box.height/2.0, r);
+	updateScalar(w, pw, box.width, r);
+	updateScalar(h, ph, box.height, r);
+	++age;
+}
+
+/* Moves the box to a box derived from this frame's estimate, such as the
+ * union of two merged tracks. It is no new measurement, so the velocity and
+ * the covariance are kept and the next detection corrects it
+ *
+ * PARAMETERS:
+ * 			- box 	 : the new box
+ *
+ * RETURN: --
+ */
+void BoxFilter::reset(const Rect_<int>& box)
+{
+	cx = box.x + box.width/2.0;
+	cy = box.y + box.height/2.0;
+	w  = box.width;
+	h  = box.height;
+}
+
+/* The estimated box */
+Rect_<int> BoxFilter::box() const
+{
+	return Rect_<int>(cvRound(cx - w/2), cvRound(cy - h/2), cvRound(max(w, 0.0f)), cvRound(max(h, 0.0f)));
+}
+
+/* Area where the center of a detection of this box is expected, gate
+ * innovation stds around the predicted center, grown by half the size
+ */
+Rect_<int> BoxFilter::window(const MotionParams& params) const
+{
+	float r  = params.measurement_noise*params.measurement_noise;
+	float dx = params.gate*sqrt(pxx + r) + w/2;
+	float dy = params.gate*sqrt(pyy + r) + h/2;
+	return Rect_<int>(cvFloor(cx - dx), cvFloor(cy - dy), cvCeil(2*dx) + 1, cvCeil(2*dy) + 1);
+}
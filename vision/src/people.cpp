@@ -0,0 +1,127 @@
+#include <people.hpp>
+
+People::People()
+{
+}
+
+People::~People()
+{
+}
+
+int People::size() const
+{
+	return order.size();
+}
+
+bool People::empty() const
+{
+	return order.empty();
+}
+
+/* Removes every track, the ids keep increasing
+ *
+ * RETURN: --
+ */
+void People::clear()
+{
+	for(int i = 0; i < order.size(); ++i)
+		free_slots.push_back(order[i]);
+	order.clear();
+}
+
+/* Starts a new track at the end of the tracking order, in a recycled slot
+ * if there is one
+ *
+ * PARAMETERS:
+ * 			- box  	 : the box of the track
+ * 			- rank 	 : its initial rank
+ * 			- motion : noise of the motion model its filter starts with
+ *
+ * RETURN:
+ * 			- the index of the track
+ */
+int People::add(const Rect_<int>& box, float rank, const MotionParams& motion)
+{
+	int slot;
+	if(!free_slots.empty())
+	{
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+	else
+	{
+		slot = x.size();
+		x.push_back(0);
+		y.push_back(0);
+		width.push_back(0);
+		height.push_back(0);
+		ranks.push_back(0);
+		ids.push_back(0);
+		positions.push_back(Position());
+		filters.push_back(BoxFilter());
+	}
+	x[slot] 		= box.x;
+	y[slot] 		= box.y;
+	width[slot] 	= box.width;
+	height[slot] 	= box.height;
+	ranks[slot] 	= rank;
+	ids[slot] 		= next_id++;
+	positions[slot] = Position();
+	filters[slot].init(box, motion);
+	order.push_back(slot);
+	return order.size() - 1;
+}
+
+/* Removes a track, the last track takes its index
+ *
+ * PARAMETERS:
+ * 			- index : index of the track
+ *
+ * RETURN: --
+ */
+void People::swapRemove(int index)
+{
+	release(order[index]);
+	order[index] = order.back();
+	order.pop_back();
+}
+
+/* Removes the flagged tracks in one pass, the others keep their order
+ *
+ * PARAMETERS:
+ * 			- dead : one flag per index
+ *
+ * RETURN: --
+ */
+void People::removeMarked(const vector<bool>& dead)
+{
+	int kept = 0;
+	for(int i = 0; i < order.size(); ++i)
+	{
+		if(dead[i])
+			release(order[i]);
+		else
+			order[kept++] = order[i];
+	}
+	order.resize(kept);
+}
+
+Rect_<int> People::box(int index) const
+{
+	int s = order[index];
+	return Rect_<int>(x[s], y[s], width[s], height[s]);
+}
+
+void People::setBox(int index, const Rect_<int>& box)
+{
+	int s 	  = order[index];
+	x[s] 	  = box.x;
+	y[s] 	  = box.y;
+	width[s]  = box.width;
+	height[s] = box.height;
+}
+
+void People::release(int slot)
+{
+	free_slots.push_back(slot);
+}
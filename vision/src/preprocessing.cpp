@@ -0,0 +1,341 @@
+#include <vision.hpp>
+#include <preprocessing.hpp>
+
+ImagePreprocessor::ImagePreprocessor(float gamma, double clip_limit, int tiles)
+{
+	setGamma(gamma);
+	setClahe(clip_limit, tiles);
+}
+
+ImagePreprocessor::~ImagePreprocessor()
+{
+}
+
+/* Sets the gamma factor, the lookup table is rebuilt only if it changed
+ *
+ * PARAMETERS:
+ * 			- gamma : the gamma factor, 1 disables the correction
+ *
+ * RETURN: --
+ */
+void ImagePreprocessor::setGamma(float gamma)
+{
+	this->gamma = gamma;
+	if(gamma != lut_gamma)
+	{
+		gammaLut(lut, gamma);
+		lut_gamma = gamma;
+	}
+}
+
+/* Configures the CLAHE instance, a non positive clip limit disables it
+ *
+ * PARAMETERS:
+ * 			- clip_limit : contrast clip limit
+ * 			- tiles 	 : number of tiles per dimension
+ *
+ * RETURN: --
+ */
+void ImagePreprocessor::setClahe(double clip_limit, int tiles)
+{
+	this->clip_limit = clip_limit;
+	this->tiles 	 = tiles;
+	if(clip_limit <= 0)
+		return;
+	if(clahe.empty())
+		clahe = createCLAHE();
+	clahe->setClipLimit(clip_limit);
+	clahe->setTilesGridSize(Size(tiles, tiles));
+}
+
+/* Applies gamma correction and CLAHE. Each enabled step runs straight from
+ * src into dst (in place when src and dst are the same Mat), so with only
+ * one of them enabled the frame is touched once and dst is reused between frames.
+ *
+ * PARAMETERS:
+ * 			- src : the grayscale image
+ * 			- dst : the Mat to store the result
+ *
+ * RETURN: --
+ */
+void ImagePreprocessor::apply(const Mat& src, Mat& dst)
+{
+	bool use_gamma = (gamma != 1.0);
+	bool use_clahe = (clip_limit > 0);
+
+	if(use_gamma)
+	{
+		LUT(src, lut, dst);
+		if(use_clahe)
+			clahe->apply(dst, dst);
+	}
+	else if(use_clahe)
+		clahe->apply(src, dst);
+	else if(src.data != dst.data)
+		src.copyTo(dst);
+}
+
+/* Tile size of the CLAHE step over a frame. Like CLAHE itself, unless both
+ * sides divide by the number of tiles the frame is taken as padded at the
+ * bottom and right by tiles - (side % tiles).
+ *
+ * PARAMETERS:
+ * 			- frame : size of the frame
+ *
+ * RETURN:
+ * 			- the tile size, 1x1 when CLAHE is disabled
+ */
+Size ImagePreprocessor::tileSize(const Size& frame) const
+{
+	if(clip_limit <= 0)
+		return Size(1, 1);
+	if(frame.width % tiles == 0 && frame.height % tiles == 0)
+		return Size(frame.width/tiles, frame.height/tiles);
+	return Size((frame.width + tiles - frame.width % tiles)/tiles, (frame.height + tiles - frame.height % tiles)/tiles);
+}
+
+/* Applies gamma correction and CLAHE inside the regions only, dst keeps its
+ * previous content elsewhere. The regions must be aligned to tileSize(). Each
+ * one is equalized together with one tile of context around it (and the
+ * frame padding where it reaches the bottom or right edge), so its tiles get
+ * the histograms and the neighbours they have in the whole frame and the
+ * output matches apply() up to the rounding of the interpolation weights.
+ *
+ * PARAMETERS:
+ * 			- src 	  : the grayscale image
+ * 			- dst 	  : the output of the previous frames, processed whole
+ * 						when it does not match src
+ * 			- regions : disjoint regions to process
+ *
+ * RETURN: --
+ */
+void ImagePreprocessor::applyRegions(const Mat& src, Mat& dst, const vector< Rect_<int> >& regions)
+{
+	if(dst.size() != src.size() || dst.type() != src.type() || src.data == dst.data)
+	{
+		apply(src, dst);
+		return;
+	}
+
+	Rect image(0, 0, src.cols, src.rows);
+	Size tile = tileSize(src.size());
+	for(int i = 0; i < regions.size(); ++i)
+	{
+		Rect region = regions[i] & image;
+		if(region.area() <= 0)
+			continue;
+		Mat out = dst(region);
+		if(clip_limit <= 0)
+		{
+			apply(src(region), out);
+			continue;
+		}
+
+		Rect context = Rect(region.x - tile.width, region.y - tile.height, region.width + 2*tile.width, region.height + 2*tile.height) & image;
+		int pad_x = (context.x + context.width == src.cols) ? tile.width*tiles - src.cols : 0;
+		int pad_y = (context.y + context.height == src.rows) ? tile.height*tiles - src.rows : 0;
+		if(gamma != 1.0)
+			LUT(src(context), lut, region_src);
+		else
+			src(context).copyTo(region_src);
+		Mat input = region_src;
+		if(pad_x > 0 || pad_y > 0)
+		{
+			copyMakeBorder(region_src, region_pad, 0, pad_y, 0, pad_x, BORDER_REFLECT_101);
+			input = region_pad;
+		}
+
+		clahe->setTilesGridSize(Size(input.cols/tile.width, input.rows/tile.height));
+		clahe->apply(input, region_dst);
+		region_dst(Rect(region.x - context.x, region.y - context.y, region.width, region.height)).copyTo(out);
+	}
+	if(clip_limit > 0)
+		clahe->setTilesGridSize(Size(tiles, tiles));
+}
+
+MotionDetector::MotionDetector(float backFactor, float threshold, int scale)
+: backFactor(backFactor), threshold(threshold), scale(max(scale, 1))
+{
+}
+
+MotionDetector::~MotionDetector()
+{
+}
+
+/* Calculates the motion mask of a frame and updates the reference, the
+ * first frame (or a change of size) initializes the reference
+ *
+ * PARAMETERS:
+ * 			- frame : the preprocessed grayscale frame
+ * 			- dif 	: the Mat to store the thresholded difference, scale
+ * 					  times smaller than the frame in pyramid mode
+ *
+ * RETURN: --
+ */
+void MotionDetector::apply(const Mat& frame, Mat& dif)
+{
+	if(scale > 1)
+	{
+		applyPyramid(frame, dif, NULL);
+		return;
+	}
+	if(ref.rows != frame.rows || ref.cols != frame.cols || ref.type() != frame.type())
+		ref = frame.clone();
+	updateBackground(frame, ref, dif, backFactor, threshold);
+}
+
+/* Calculates the motion mask inside the regions only, the mask is zero and
+ * the reference is left as it is elsewhere. Without a reference of the
+ * frame size the whole frame is processed.
+ *
+ * PARAMETERS:
+ * 			- frame   : the preprocessed grayscale frame
+ * 			- dif 	  : the Mat to store the thresholded difference
+ * 			- regions : disjoint regions to process
+ *
+ * RETURN: --
+ */
+void MotionDetector::applyRegions(const Mat& frame, Mat& dif, const vector< Rect_<int> >& regions)
+{
+	if(scale > 1)
+	{
+		applyPyramid(frame, dif, &regions);
+		return;
+	}
+	if(ref.rows != frame.rows || ref.cols != frame.cols || ref.type() != frame.type())
+	{
+		apply(frame, dif);
+		return;
+	}
+	dif.create(frame.rows, frame.cols, frame.type());
+	dif.setTo(Scalar(0));
+	Rect image(0, 0, frame.cols, frame.rows);
+	for(int i = 0; i < regions.size(); ++i)
+	{
+		Rect region = regions[i] & image;
+		if(region.area() <= 0)
+			continue;
+		Mat ref_region = ref(region);
+		Mat dif_region = dif(region);
+		updateBackground(frame(region), ref_region, dif_region, backFactor, threshold);
+	}
+}
+
+/* Pyramid mode of apply and applyRegions. The frame (cropped to a multiple
+ * of scale) is area downsampled, then the reference is updated and the
+ * difference thresholded at that level, the reference of before this frame
+ * is kept for refine.
+ *
+ * PARAMETERS:
+ * 			- frame   : the preprocessed grayscale frame
+ * 			- dif 	  : the Mat to store the coarse mask
+ * 			- regions : when not NULL only these full resolution regions
+ * 						are processed, as in applyRegions
+ *
+ * RETURN: --
+ */
+void MotionDetector::applyPyramid(const Mat& frame, Mat& dif, const vector< Rect_<int> >* regions)
+{
+	Size size(frame.cols/scale, frame.rows/scale);
+	resize(frame(Rect(0, 0, size.width*scale, size.height*scale)), coarse, size, 0, 0, INTER_AREA);
+	bool whole = (regions == NULL || ref.size() != size || ref.type() != frame.type());
+	if(ref.size() != size || ref.type() != frame.type())
+		ref = coarse.clone();
+	ref.copyTo(previous);
+
+	if(whole)
+	{
+		updateBackground(coarse, ref, dif, backFactor, threshold);
+		return;
+	}
+
+	//The regions are scaled down with their edges rounded the same way, so
+	//they stay disjoint
+	dif.create(size, frame.type());
+	dif.setTo(Scalar(0));
+	for(int i = 0; i < regions->size(); ++i)
+	{
+		const Rect_<int>& region = (*regions)[i];
+		int x0 = min(region.x/scale, size.width);
+		int y0 = min(region.y/scale, size.height);
+		int x1 = min((region.x + region.width)/scale, size.width);
+		int y1 = min((region.y + region.height)/scale, size.height);
+		if(x1 <= x0 || y1 <= y0)
+			continue;
+		Rect area(x0, y0, x1 - x0, y1 - y0);
+		Mat ref_region = ref(area);
+		Mat dif_region = dif(area);
+		updateBackground(coarse(area), ref_region, dif_region, backFactor, threshold);
+	}
+}
+
+/* Turns the blobs detected on the coarse mask of the last frame into full
+ * resolution boxes. Inside every blob, grown by one coarse pixel, the full
+ * resolution frame is compared with the reference of before that frame (a
+ * reference pixel stands for a scale x scale block) and the box is set to
+ * the extent of the pixels that moved, plus range like detectBlobs does.
+ * Every row is scanned from both ends only until its first and last moving
+ * pixel. Blobs without a moving pixel at full resolution are dropped.
+ *
+ * PARAMETERS:
+ * 			- frame : the frame given to the last apply
+ * 			- blobs : blobs of the coarse mask, replaced by the refined boxes
+ * 			- range : the blob range at full resolution
+ *
+ * RETURN: --
+ */
+void MotionDetector::refine(const Mat& frame, vector< Rect_<int> >& blobs, int range) const
+{
+	if(scale <= 1 || previous.empty())
+		return;
+	int limit  = min(max(int(floor(threshold)), -1), 255);
+	int last_x = previous.cols - 1;
+	int last_y = previous.rows - 1;
+	Rect image(0, 0, frame.cols, frame.rows);
+	int kept = 0;
+	for(int b = 0; b < blobs.size(); ++b)
+	{
+		const Rect_<int>& blob = blobs[b];
+		Rect box = Rect((blob.x - 1)*scale, (blob.y - 1)*scale, (blob.width + 2)*scale, (blob.height + 2)*scale) & image;
+		int x0 = frame.cols;
+		int y0 = frame.rows;
+		int x1 = -1;
+		int y1 = -1;
+		for(int y = box.y; y < box.y + box.height; ++y)
+		{
+			const uchar* cur  = frame.ptr<uchar>(y);
+			const uchar* back = previous.ptr<uchar>(min(y/scale, last_y));
+			int first = box.x;
+			int end   = box.x + box.width;
+			while(first < end && abs(cur[first] - back[min(first/scale, last_x)]) <= limit)
+				++first;
+			if(first == end)
+				continue;
+			int last = end - 1;
+			while(last > first && abs(cur[last] - back[min(last/scale, last_x)]) <= limit)
+				--last;
+			x0 = min(x0, first);
+			x1 = max(x1, last);
+			y0 = min(y0, y);
+			y1 = y;
+		}
+		if(x1 < 0)
+			continue;
+		blobs[kept++] = Rect_<int>(x0, y0, x1 - x0 + range, y1 - y0 + range) & image;
+	}
+	blobs.resize(kept);
+}
+
+/* Drops the reference, the next frame starts a new one
+ *
+ * RETURN: --
+ */
+void MotionDetector::reset()
+{
+	ref.release();
+}
+
+const Mat& MotionDetector::reference() const
+{
+	return ref;
+}
@@ -0,0 +1,120 @@
+#include <profiler.hpp>
+
+static const char* stage_names[STAGE_COUNT] = {"frame", "decode", "preprocess", "background", "depth_filter",
+	"blobs", "track", "depth", "features", "publish"};
+
+const char* stageName(int stage)
+{
+	return (stage >= 0 && stage < STAGE_COUNT) ? stage_names[stage] : "unknown";
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	for(int i = 0; i < BUCKETS; ++i)
+		counts[i].store(0, memory_order_relaxed);
+}
+
+/* Adds one duration
+ * 
+ * PARAMETERS:
+ * 			- ns : the duration in nanoseconds
+ * 
+ * RETURN: --
+ */
+void LatencyHistogram::record(int64_t ns)
+{
+	counts[bucket(ns)].fetch_add(1, memory_order_relaxed);
+}
+
+/* Copies the counts and resets them, so every report covers the durations
+ * recorded since the previous one
+ * 
+ * PARAMETERS:
+ * 			- out : the counts of every bucket
+ * 
+ * RETURN: --
+ */
+void LatencyHistogram::take(uint32_t out[BUCKETS])
+{
+	for(int i = 0; i < BUCKETS; ++i)
+		out[i] = counts[i].exchange(0, memory_order_relaxed);
+}
+
+/* Bucket of a duration: microseconds below 4 map to themselves, above
+ * that every power of two is split in four
+ */
+int LatencyHistogram::bucket(int64_t ns)
+{
+	uint64_t us = (ns > 0) ? (uint64_t)ns/1000 : 0;
+	if(us < 4)
+		return us;
+	int e = 63 - __builtin_clzll(us);
+	int index = (e - 1)*4 + ((us >> (e - 2)) & 3);
+	return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+/* Middle of a bucket in microseconds */
+double LatencyHistogram::bucketValue(int index)
+{
+	if(index < 4)
+		return index + 0.5;
+	int e 	= index/4 + 1;
+	int sub = index%4;
+	double low = (double)((4 + sub) << (e - 2));
+	return low + (double)(1 << (e - 2))/2;
+}
+
+/* Percentile of a snapshot taken with take()
+ * 
+ * PARAMETERS:
+ * 			- counts : the bucket counts
+ * 			- q 	 : the percentile in [0, 1]
+ * 
+ * RETURN:
+ * 			- the duration in microseconds, 0 if nothing was recorded
+ */
+double LatencyHistogram::percentile(const uint32_t counts[BUCKETS], double q)
+{
+	uint64_t total = 0;
+	for(int i = 0; i < BUCKETS; ++i)
+		total += counts[i];
+	if(total == 0)
+		return 0.0;
+
+	uint64_t rank = (uint64_t)(q*(total - 1)) + 1;
+	uint64_t seen = 0;
+	for(int i = 0; i < BUCKETS; ++i)
+	{
+		seen += counts[i];
+		if(seen >= rank)
+			return bucketValue(i);
+	}
+	return bucketValue(BUCKETS - 1);
+}
+
+Profiler::Profiler(bool enabled)
+: enabled(enabled)
+{
+}
+
+void Profiler::record(int stage, int64_t ns)
+{
+	stages[stage].record(ns);
+}
+
+void Profiler::take(int stage, uint32_t counts[LatencyHistogram::BUCKETS])
+{
+	stages[stage].take(counts);
+}
+
+/* Drops the counts of every stage, the next take only covers the durations
+ * recorded from now on
+ * 
+ * RETURN: --
+ */
+void Profiler::reset()
+{
+	uint32_t counts[LatencyHistogram::BUCKETS];
+	for(int stage = 0; stage < STAGE_COUNT; ++stage)
+		stages[stage].take(counts);
+}
@@ -0,0 +1,101 @@
+#include <recording.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <dirent.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fstream>
+#include <algorithm>
+#include <map>
+
+/* Number of a frame file named prefix_N.ext, -1 if the name does not match */
+static long frameNumber(const string& name, const string& prefix, const string& ext)
+{
+	if(name.size() <= prefix.size() + ext.size() || name.compare(0, prefix.size(), prefix) != 0
+	   || name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+		return -1;
+	string digits = name.substr(prefix.size(), name.size() - prefix.size() - ext.size());
+	if(digits.empty() || digits.find_first_not_of("0123456789") != string::npos)
+		return -1;
+	return atol(digits.c_str());
+}
+
+/* Lists the frames of a recorded sequence in order of their number
+ * 
+ * PARAMETERS:
+ * 			- dir 	 : the directory
+ * 			- frames : filled with every number that has an rgb or a depth frame
+ * 
+ * RETURN:
+ * 			- false if the directory cannot be read
+ */
+bool listRecording(const string& dir, vector<RecordedFrame>& frames)
+{
+	frames.clear();
+	DIR* handle = opendir(dir.c_str());
+	if(!handle)
+		return false;
+
+	map<long, RecordedFrame> numbered;
+	while(struct dirent* entry = readdir(handle))
+	{
+		string name = entry->d_name;
+		string path = dir + "/" + name;
+		long number;
+		if((number = frameNumber(name, "rgb_", ".png")) >= 0)
+			numbered[number].rgb = path;
+		else if((number = frameNumber(name, "depth_", ".png")) >= 0 || (number = frameNumber(name, "depth_", ".raw")) >= 0)
+			numbered[number].depth = path;
+	}
+	closedir(handle);
+
+	for(map<long, RecordedFrame>::iterator it = numbered.begin(); it != numbered.end(); ++it)
+	{
+		it->second.number = it->first;
+		frames.push_back(it->second);
+	}
+	return true;
+}
+
+/* Reads a depth frame in mm. Raw files are 16 bit or float depending on
+ * their size. 16 bit frames stay 16UC1 (cleanDepth takes them as they are),
+ * anything else is converted to 32FC1.
+ * 
+ * PARAMETERS:
+ * 			- path 	   : depth_N.png or depth_N.raw
+ * 			- raw_size : frame size of raw files
+ * 			- depth    : the depth frame
+ * 
+ * RETURN:
+ * 			- false if the file cannot be read or a raw file has the wrong size
+ */
+bool readRecordedDepth(const string& path, Size raw_size, Mat& depth)
+{
+	if(path.size() > 4 && path.compare(path.size() - 4, 4, ".raw") == 0)
+	{
+		ifstream in(path.c_str(), ios::in | ios::binary | ios::ate);
+		size_t bytes  = in ? size_t(in.tellg()) : 0;
+		size_t pixels = raw_size.area();
+		int type;
+		if(bytes == pixels*sizeof(float))
+			type = CV_32FC1;
+		else if(bytes == pixels*sizeof(uint16_t))
+			type = CV_16UC1;
+		else
+			return false;
+		Mat raw(raw_size, type);
+		in.seekg(0);
+		in.read((char*)raw.data, bytes);
+		depth = raw;
+	}
+	else
+	{
+		Mat png = imread(path, -1);
+		if(png.empty())
+			return false;
+		if(png.type() == CV_16UC1)
+			depth = png;
+		else
+			png.convertTo(depth, CV_32FC1);
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+#include <rect_grid.hpp>
+
+/* Creates a grid that covers a width x height image
+ *
+ * PARAMETERS:
+ * 			- width 	  : image width
+ * 			- height 	  : image height
+ * 			- cell_width  : width of a grid cell in pixels
+ * 			- cell_height : height of a grid cell in pixels
+ */
+RectGrid::RectGrid(int width, int height, int cell_width, int cell_height)
+: cell_width(max(cell_width, 1)), cell_height(max(cell_height, 1))
+{
+	grid_cols = max((width  + this->cell_width  - 1)/this->cell_width, 1);
+	grid_rows = max((height + this->cell_height - 1)/this->cell_height, 1);
+	cells.resize(grid_cols*grid_rows);
+}
+
+RectGrid::~RectGrid()
+{
+}
+
+/* Removes every registered rectangle, the cell storage is kept for reuse
+ *
+ * RETURN: --
+ */
+void RectGrid::clear()
+{
+	for(int i = 0; i < cells.size(); ++i)
+		cells[i].clear();
+}
+
+/* Registers a rectangle in every cell it covers. Inserting the same index
+ * again (e.g. after the rectangle grew) is allowed, queries report it once.
+ *
+ * PARAMETERS:
+ * 			- index : caller defined id of the rectangle
+ * 			- rect  : the rectangle
+ *
+ * RETURN: --
+ */
+void RectGrid::insert(int index, const Rect& rect)
+{
+	int x0, y0, x1, y1;
+	cellRange(rect, x0, y0, x1, y1);
+	for(int y = y0; y <= y1; ++y)
+		for(int x = x0; x <= x1; ++x)
+			cells[y*grid_cols + x].push_back(index);
+
+	if(index >= visited.size())
+		visited.resize(index + 1, 0);
+}
+
+/* Collects the ids of the rectangles that share at least one cell with
+ * the given area. The result is a superset of the intersecting rectangles,
+ * the caller is expected to do the exact test.
+ *
+ * PARAMETERS:
+ * 			- area   : the area to look up
+ * 			- result : vector to store the ids found (cleared first)
+ *
+ * RETURN: --
+ */
+void RectGrid::query(const Rect& area, vector<int>& result)
+{
+	int x0, y0, x1, y1;
+	result.clear();
+	cellRange(area, x0, y0, x1, y1);
+
+	//Stamp every visited id with the query number so that
+	//rectangles spanning many cells are only reported once
+	if(++query_id == 0)
+	{
+		fill(visited.begin(), visited.end(), 0);
+		query_id = 1;
+	}
+	for(int y = y0; y <= y1; ++y)
+	{
+		for(int x = x0; x <= x1; ++x)
+		{
+			const vector<int>& cell = cells[y*grid_cols + x];
+			for(int k = 0; k < cell.size(); ++k)
+			{
+				int index = cell[k];
+				if(visited[index] != query_id)
+				{
+					visited[index] = query_id;
+					result.push_back(index);
+				}
+			}
+		}
+	}
+}
+
+/* Converts a rectangle to the inclusive range of cells it covers,
+ * clamped to the grid
+ */
+void RectGrid::cellRange(const Rect& rect, int& x0, int& y0, int& x1, int& y1) const
+{
+	x0 = min(max(rect.x/cell_width, 0), grid_cols - 1);
+	y0 = min(max(rect.y/cell_height, 0), grid_rows - 1);
+	x1 = min(max((rect.x + max(rect.width, 1) - 1)/cell_width, 0), grid_cols - 1);
+	y1 = min(max((rect.y + max(rect.height, 1) - 1)/cell_height, 0), grid_rows - 1);
+}
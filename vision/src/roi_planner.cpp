@@ -0,0 +1,133 @@
+#include <roi_planner.hpp>
+#include <math.h>
+
+RoiPlanner::RoiPlanner(const RoiParams& params)
+: params(params)
+{
+}
+
+RoiPlanner::~RoiPlanner()
+{
+}
+
+void RoiPlanner::setParams(const RoiParams& params)
+{
+	this->params = params;
+}
+
+/* Stores the boxes tracked in a frame. A feedback that follows the previous
+ * one within max_age counts towards stable_frames, a late one starts over.
+ *
+ * PARAMETERS:
+ * 			- boxes : the tracked boxes, in frame pixels
+ * 			- stamp : stamp of the frame they were tracked in, in seconds
+ *
+ * RETURN: --
+ */
+void RoiPlanner::setTracks(const vector< Rect_<int> >& boxes, double stamp)
+{
+	if(feedbacks > 0 && fabs(stamp - tracks_stamp) <= params.max_age)
+		++feedbacks;
+	else
+		feedbacks = 1;
+	tracks 		 = boxes;
+	tracks_stamp = stamp;
+}
+
+/* Forgets the feedback, the following frames are processed whole until it
+ * is stable again
+ *
+ * RETURN: --
+ */
+void RoiPlanner::reset()
+{
+	tracks.clear();
+	feedbacks 	= 0;
+	since_sweep = 0;
+}
+
+/* Plans the processing of a frame
+ *
+ * PARAMETERS:
+ * 			- frame   : size of the frame
+ * 			- tile 	  : the regions are aligned to this grid
+ * 			- stamp   : stamp of the frame, in seconds
+ * 			- regions : filled with the disjoint regions to process, may stay
+ * 						empty when nothing is tracked
+ *
+ * RETURN:
+ * 			- true to process only the regions, false for the whole frame
+ */
+bool RoiPlanner::plan(const Size& frame, const Size& tile, double stamp, vector< Rect_<int> >& regions)
+{
+	regions.clear();
+	frame_area += frame.area();
+
+	//The feedback stopped, the tracker may be behind or gone
+	if(feedbacks > 0 && fabs(stamp - tracks_stamp) > params.max_age)
+		feedbacks = 0;
+	if(feedbacks < params.stable_frames || ++since_sweep >= params.sweep_period)
+	{
+		since_sweep = 0;
+		processed_area += frame.area();
+		return false;
+	}
+
+	//Boxes grown by the margin and a quarter of their size, against the
+	//movement since the frame they were tracked in, snapped to the tiles
+	Rect_<int> image(0, 0, frame.width, frame.height);
+	int tile_w = max(tile.width, 1);
+	int tile_h = max(tile.height, 1);
+	for(int i = 0; i < tracks.size(); ++i)
+	{
+		const Rect_<int>& box = tracks[i];
+		int grow = params.margin + max(box.width, box.height)/4;
+		Rect_<int> area = Rect_<int>(box.x - grow, box.y - grow, box.width + 2*grow, box.height + 2*grow) & image;
+		if(area.area() <= 0)
+			continue;
+		int x0 = (area.x/tile_w)*tile_w;
+		int y0 = (area.y/tile_h)*tile_h;
+		int x1 = min(((area.x + area.width + tile_w - 1)/tile_w)*tile_w, frame.width);
+		int y1 = min(((area.y + area.height + tile_h - 1)/tile_h)*tile_h, frame.height);
+		regions.push_back(Rect_<int>(x0, y0, x1 - x0, y1 - y0));
+	}
+
+	//Overlapping regions are replaced by their union until none overlap,
+	//the union of aligned regions stays aligned
+	bool merged = true;
+	while(merged)
+	{
+		merged = false;
+		for(int a = 0; a < regions.size(); ++a)
+		{
+			for(int b = a + 1; b < regions.size(); ++b)
+			{
+				if((regions[a] & regions[b]).area() > 0)
+				{
+					regions[a] |= regions[b];
+					regions[b] = regions.back();
+					regions.pop_back();
+					merged = true;
+					--b;
+				}
+			}
+		}
+	}
+
+	double area = 0.0;
+	for(int i = 0; i < regions.size(); ++i)
+		area += regions[i].area();
+	if(area > params.max_coverage*frame.area())
+	{
+		regions.clear();
+		processed_area += frame.area();
+		return false;
+	}
+	processed_area += area;
+	return true;
+}
+
+double RoiPlanner::occupancy() const
+{
+	return frame_area > 0 ? processed_area/frame_area : 1.0;
+}
@@ -1,168 +1,27 @@
 #include <vision.hpp>
+#include <rect_grid.hpp>
 #include <exception>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-/* Detects non-black rectangle areas in a black image. This 
- * to produce ROIS(Regions of interest) for further processing.
- *    
- *
- * PARAMETERS: 
- * 			- src		   : the Mat object that holds the image
- * 			- colour_areas : the rectangles produced 
- * 			- range		   : the starting dimension of each rectangle
- * 			- subsampling  : number of pixels to skip at each iteration
- * 			- detect_people: filter boxes(unfinished)
- * 
- * RETURN --
+/* Merge rule of the second tracking pass: the boxes overlap horizontally
+ * and are less than height/20 apart vertically
  */
-void detectBlobs(const Mat& src, vector< Rect_<int> >& colour_areas, int range, int subsampling, bool detect_people)
+static bool mergeable(Rect_<int> removal, const Rect_<int>& rect, int height)
 {
-	bool flag 	 		   = false;
-	int cols     		   = src.cols;
-	int rows 	 		   = src.rows;
-	int channels 		   = src.channels();
-	int size 			   = cols*rows*channels;
-	
-	//Starting from the 1st non-zero pixel it starts forming rectangles (range x range)
-	//and fuses them if their intersection is above a certain threshold.
-	for(int y = 0; y < 1; y++)
-	{
-		const uchar *dif = src.ptr<uchar>(y);
-		for(int x = 0; x < size; x = x + subsampling*channels)
-		{
-			if(dif[x] != 0)
-			{		
-				int i = floor((x/channels)%(cols)); 
-				int j = floor(x/(cols*channels));
-				
-				//If the rect is out of bounds skip
-				if((i + range >= cols) || (j + range >= rows))
-					continue;
-				
-				Rect_<int> removal = Rect(i, j, range , range);
-					
-				if(!colour_areas.empty())
-				{
-					for(int k = 0; k < colour_areas.size(); k++)
-					{
-						Rect_<int> rect   = colour_areas[k];
-						Rect all 		  = removal | rect;
-						Rect intersection = removal & rect;
-						int threshold 	  = intersection.area();
-						
-						if(threshold > 0)
-						{
-							flag = true;
-							colour_areas[k] = all;
-							break;
-						}
-					
-					}
-					if(!flag)
-						colour_areas.push_back(removal);
-					else
-						flag = false;
-				}
-				else
-					colour_areas.push_back(removal);
-			}
-			
-		}
-	}
-	
-	//In this phase we loop through all the produced rectangles and again try to merge those whose
-	//intersection is above a certain threshold	
-	int end = colour_areas.size();	
-	for(int a = 0; a < end; a++) 
-	{
-		for(int b = a + 1; b < end; b++) 
-		{	
-			Rect_<int> removal = colour_areas[a];
-			Rect_<int> rect    = colour_areas[b];
-			Rect all 		   = removal | rect;
-			Rect intersection  = removal & rect;
-			int threshold = intersection.area();
-			if(threshold == 0)
-			{
-				int y_distance = 0;
-				if (removal.y < rect.y)
-					y_distance = rect.y - (removal.y + removal.height);
-				else
-					y_distance = removal.y - (rect.y + rect.height);
-				if(y_distance < rows/20)
-				{
-					int y_temp 	 = removal.y;
-					removal.y 	 = rect.y;
-					intersection = removal & rect;
-					threshold 	 = intersection.area();
-					if(threshold == 0)
-					{
-						int x_distance = cols;
-						if (removal.x < rect.x)
-							x_distance = rect.x - (removal.x + removal.width);
-						else
-							x_distance = removal.x - (rect.x + rect.width);
-						
-						
-						float area_thres = max(removal.area(), rect.area());
-						if((x_distance < cols/50) && (all.area() < 2*area_thres))
-						{
-							threshold = 1;
-						}
-					}
-					removal.y = y_temp;
-				}
-			}
-				
-			if(threshold > 0)
-			{
-				colour_areas[a] = all;
-				colour_areas[b] = colour_areas.back();
-				colour_areas.pop_back();
-				a = -1;
-				end--;
-				break;
-			}
-			
-		}
-	}	
-	vector< Rect_<int> >::iterator it;					
-	//Filter out erroneous areas (dimensions < 0) that sometimes occur
-	for(it = colour_areas.begin(); it < colour_areas.end();)
-	{
-		Rect_<int> rect = *it; 
-		float x  	 = rect.x;
-		float y 	 = rect.y;
-		float width  = rect.width;
-		float height = rect.height;
-		if((x < 0) || (y < 0) || (height <= 0) || (width <= 0))
-			it = colour_areas.erase(it);
-		else
-			it++;
-	}
-	
-	//Filter out areas whose ratio cannot belong to a human
-	if(detect_people)
-	{
-		
-		vector< Rect_<int> >::iterator it;
-		for(it = colour_areas.begin(); it < colour_areas.end();)
-		{
-			Rect_<int> rect = *it; 
-			float width  = rect.width;
-			float height = rect.height;
-			float area   = rect.area();
-			float ratio  = width/height;
-			if((ratio < 0.25) || (ratio > 1.5) || (area < cols*rows*0.02))
-				it = colour_areas.erase(it);
-			else
-				it++;
-		}
-	}
+	int y_distance = height;
+	if (removal.y < rect.y)
+		y_distance = rect.y - (removal.y + removal.height);
+	else
+		y_distance = removal.y - (rect.y + rect.height);
 	
-	//~ cout<<"Size: "<<colour_areas.size()<<endl;
-	//~ for(Rect rect: colour_areas)
-	//~ cout<<rect.x<<" "<<rect.y<<" "<<rect.width<<" "<<rect.height<<endl;
-	//~ rectangle(src, rect, CV_RGB(255, 255, 255), 1);
+	if(y_distance >= height/20)
+		return false;
+	removal.y = rect.y;
+	return (removal & rect).area() > 0;
 }
 
 /* Tracks current rectangle in the image and populates a
@@ -170,45 +29,103 @@ void detectBlobs(const Mat& src, vector< Rect_<int> >& colour_areas, int range,
  * is redetected and decreases otherwise. The threshold that is used to compare
  * the detected boxes with the stored ones. 
  *
+ * With a motion model every box is first moved to the place its constant
+ * velocity filter predicts, only the detections centered in the gated window
+ * around the prediction are matched to it, the filter estimate replaces
+ * the averaging rules and its velocity gives the x_diff, y_diff and distance
+ * features. A box that is not redetected keeps moving with its prediction.
+ *
  * 
  * PARAMETERS: 
  * 			- cur_boxes  : current image rectangles
  * 			- collection : the collection to be populated
  * 			- rank  	 : the initial rank of a new box, 
  * 			- max_rank  	 : the initial rank of a new box, 
- * 			- threshold  : rectangle comparison threshold
+ * 			- motion 	 : noise and gate of the motion model, NULL to not use it
  * 
  * RETURN --
  */
-void track(vector< Rect_<int> >& cur_boxes, People& collection, int width, int height, int rank, int max_rank)
+void track(vector< Rect_<int> >& cur_boxes, People& collection, int width, int height, int rank, int max_rank, const MotionParams* motion)
 {
 	
 	float step  = 1.5;
-	vector<bool> updates(collection.tracked_boxes.size(), false);
+	vector<bool> updates(collection.size(), false);
+	Rect image(0, 0, width, height);
+	
+	//Every box moves to its predicted place, it stays there unless redetected
+	if(motion)
+	{
+		for(int a = 0; a < collection.size(); ++a)
+		{
+			collection.filter(a).predict(*motion);
+			collection.setBox(a, collection.filter(a).box() & image);
+		}
+	}
+	
 	if(!cur_boxes.empty())
 	{	
+		//Spatial index of the detections, a detection is claimed by the first
+		//tracked box it matches and flagged instead of erased
+		RectGrid grid(width, height, max(width/8, 1), max(height/8, 1));
+		vector<bool> claimed(cur_boxes.size(), false);
+		vector<int> candidates;
+		int max_width  = 0;
+		int max_height = 0;
+		for(int k = 0; k < cur_boxes.size(); ++k)
+		{
+			grid.insert(k, cur_boxes[k]);
+			max_width  = max(max_width, cur_boxes[k].width);
+			max_height = max(max_height, cur_boxes[k].height);
+		}
+		
 		Rect_<int> all;
 		//We reposition every tracked box with a union of
 		//the boxes that fall in its area 
-		for(int a = 0; a < collection.tracked_boxes.size(); ++a) 
+		for(int a = 0; a < collection.size(); ++a) 
 		{	
 			all = Rect(0,0,0,0);
-			for(vector< Rect_<int> >::iterator it = cur_boxes.begin(); it < cur_boxes.end();) 
+			
+			//A detection matches when its union with the tracked box is less than
+			//10% larger than the larger of the two, so it lies within a tenth of
+			//the larger size around the tracked box. With the motion model it
+			//matches when its center falls in the gated window of the prediction
+			Rect_<int> tracked = collection.box(a);
+			Position& pos 	   = collection.pos(a);
+			Rect_<int> window;
+			if(motion)
+				window = collection.filter(a).window(*motion);
+			else
+			{
+				int margin_x = max(tracked.width, max_width)/10 + 1;
+				int margin_y = max(tracked.height, max_height)/10 + 1;
+				window = Rect(tracked.x - margin_x, tracked.y - margin_y, tracked.width + 2*margin_x, tracked.height + 2*margin_y);
+			}
+			grid.query(window, candidates);
+			sort(candidates.begin(), candidates.end());
+			for(int c = 0; c < candidates.size(); ++c) 
 			{
-				Rect_<int> cur_box = *it;
-				Rect intersection = cur_box | collection.tracked_boxes[a];
-				int threshold = intersection.area();	
-				float area_thres = max(cur_box.area(), collection.tracked_boxes[a].area());
-				if(threshold > 0 && threshold < 1.1*area_thres)
+				int k = candidates[c];
+				if(claimed[k])
+					continue;
+				Rect_<int> cur_box = cur_boxes[k];
+				bool match;
+				if(motion)
+					match = window.contains(Point(cur_box.x + cur_box.width/2, cur_box.y + cur_box.height/2));
+				else
+				{
+					Rect intersection = cur_box | tracked;
+					int threshold = intersection.area();	
+					float area_thres = max(cur_box.area(), tracked.area());
+					match = threshold > 0 && threshold < 1.1*area_thres;
+				}
+				if(match)
 				{
 					if (all.area() == 0)
 						all = cur_box;
 					else
 						all = cur_box | all;
-					it = cur_boxes.erase(it);
+					claimed[k] = true;
 				}
-				else
-					++it;
 			}
 			
 			//The reposition rules
@@ -218,27 +135,37 @@ void track(vector< Rect_<int> >& cur_boxes, People& collection, int width, int h
 				float y_new;
 				float w_new;
 				float h_new;
-				if(all.area() > collection.tracked_boxes[a].area())
+				if(motion)
 				{
-					x_new = (all.x + collection.tracked_boxes[a].x)/2;
-					y_new = (all.y  + collection.tracked_boxes[a].y)/2;
-					w_new = (all.width + collection.tracked_boxes[a].width)/2;
-					h_new = (all.height + collection.tracked_boxes[a].height)/2;
+					BoxFilter& filter = collection.filter(a);
+					filter.update(all, *motion);
+					Rect_<int> estimate = filter.box() & image;
+					x_new = estimate.x;
+					y_new = estimate.y;
+					w_new = estimate.width;
+					h_new = estimate.height;
+				}
+				else if(all.area() > tracked.area())
+				{
+					x_new = (all.x + tracked.x)/2;
+					y_new = (all.y  + tracked.y)/2;
+					w_new = (all.width + tracked.width)/2;
+					h_new = (all.height + tracked.height)/2;
 				}
 				else
 				{
 						
 					float thresh = 1;
 					float factor = 160; 
-					float power = 5*float(collection.tracked_boxes[a].area())/float(all.area());
-					float x_dif = (all.x - collection.tracked_boxes[a].x);
-					float y_dif = (all.y - collection.tracked_boxes[a].y);
-					float w_dif = (all.width - collection.tracked_boxes[a].width);
-					float h_dif = (all.height - collection.tracked_boxes[a].height);
-					x_new = collection.tracked_boxes[a].x + x_dif/(power);
-					y_new = collection.tracked_boxes[a].y + y_dif/(power);
-					w_new = collection.tracked_boxes[a].width  + (abs((w_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : w_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
-					h_new = collection.tracked_boxes[a].height + (abs((h_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : h_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
+					float power = 5*float(tracked.area())/float(all.area());
+					float x_dif = (all.x - tracked.x);
+					float y_dif = (all.y - tracked.y);
+					float w_dif = (all.width - tracked.width);
+					float h_dif = (all.height - tracked.height);
+					x_new = tracked.x + x_dif/(power);
+					y_new = tracked.y + y_dif/(power);
+					w_new = tracked.width  + (abs((w_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : w_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
+					h_new = tracked.height + (abs((h_dif*(abs(x_dif) + abs(y_dif) + 1))/(factor*(power + 1)))  < thresh? 0 : h_dif* (abs(x_dif) + abs(y_dif) + 1)/(factor*(power + 1)));
 					
 					if(w_new < 0)
 						w_new = 0;
@@ -249,159 +176,257 @@ void track(vector< Rect_<int> >& cur_boxes, People& collection, int width, int h
 				//****************************
 				
 				//Ratio feature
-				float ratio = float(collection.tracked_boxes[a].height)/float(collection.tracked_boxes[a].width);
-				collection.tracked_pos[a].ratio_diff = ratio - collection.tracked_pos[a].ratio;
-				collection.tracked_pos[a].ratio      = ratio;
+				float ratio = float(tracked.height)/float(tracked.width);
+				pos.ratio_diff = ratio - pos.ratio;
+				pos.ratio      = ratio;
 				
 				//Area feature
 				float area = w_new*h_new;
-				collection.tracked_pos[a].area_diff = area - collection.tracked_pos[a].area;
-				collection.tracked_pos[a].area      = area;
+				pos.area_diff = area - pos.area;
+				pos.area      = area;
 				
 				//x_diff and y_diff
-				float x_diff = (x_new - collection.tracked_boxes[a].x)/area;
-				float y_diff = (y_new - collection.tracked_boxes[a].y)/area;
-				collection.tracked_pos[a].x_delta = x_diff - collection.tracked_pos[a].x_diff;
-				collection.tracked_pos[a].y_delta = y_diff - collection.tracked_pos[a].y_diff;
-				collection.tracked_pos[a].x_diff  = x_diff;
-				collection.tracked_pos[a].y_diff  = y_diff;
+				float x_diff = (x_new - tracked.x)/area;
+				float y_diff = (y_new - tracked.y)/area;
+				if(motion)
+				{
+					x_diff = collection.filter(a).vx/area;
+					y_diff = collection.filter(a).vy/area;
+				}
+				pos.x_delta = x_diff - pos.x_diff;
+				pos.y_delta = y_diff - pos.y_diff;
+				pos.x_diff  = x_diff;
+				pos.y_diff  = y_diff;
 				
 				//y_norm
 				float y_norm = y_new/area;
-				collection.tracked_pos[a].y_norm_diff = y_norm - collection.tracked_pos[a].y_norm;
-				collection.tracked_pos[a].y_norm 	  = y_norm;
+				pos.y_norm_diff = y_norm - pos.y_norm;
+				pos.y_norm 	  = y_norm;
 				
 				//Distance feature
 				int x1 = (x_new + w_new/2);
 				int y1 = (y_new + h_new/2);
-				int x2 = (collection.tracked_boxes[a].x + collection.tracked_boxes[a].width/2);
-				int y2 = (collection.tracked_boxes[a].y + collection.tracked_boxes[a].height/2);
+				int x2 = (tracked.x + tracked.width/2);
+				int y2 = (tracked.y + tracked.height/2);
 				float distance = sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2))/area;
-				collection.tracked_pos[a].distance_diff = distance - collection.tracked_pos[a].distance;
-				collection.tracked_pos[a].distance      = distance;
+				if(motion)
+					distance = sqrt(pow(collection.filter(a).vx, 2) + pow(collection.filter(a).vy, 2))/area;
+				pos.distance_diff = distance - pos.distance;
+				pos.distance      = distance;
 				
 				
 				
 				//assign the new values
-				collection.tracked_boxes[a].x 	   = x_new;
-				collection.tracked_boxes[a].y  	   = y_new;
-				collection.tracked_boxes[a].width  = w_new;
-				collection.tracked_boxes[a].height = h_new;
+				tracked.x 	   = x_new;
+				tracked.y  	   = y_new;
+				tracked.width  = w_new;
+				tracked.height = h_new;
 				
 				//***************************
 				
 				//check we did not exceed the limits 
-				if(collection.tracked_boxes[a].x + collection.tracked_boxes[a].width > width)
-					collection.tracked_boxes[a].width = width - collection.tracked_boxes[a].x;
-				if(collection.tracked_boxes[a].y + collection.tracked_boxes[a].height > height)
-					collection.tracked_boxes[a].height = height - collection.tracked_boxes[a].y;
-					
+				if(tracked.x + tracked.width > width)
+					tracked.width = width - tracked.x;
+				if(tracked.y + tracked.height > height)
+					tracked.height = height - tracked.y;
+				
+				collection.setBox(a, tracked);
 				updates.at(a) = true;	
 			}
 			
 			
 		}
-		for(int a = 0; a < cur_boxes.size(); ++a) 
+		//The unclaimed detections start new boxes and are left in cur_boxes
+		int unclaimed = 0;
+		for(int k = 0; k < cur_boxes.size(); ++k) 
 		{
-			Position pos;
-			collection.tracked_pos.push_back(pos);
-			collection.tracked_boxes.push_back(cur_boxes[a]);
-			collection.tracked_rankings.push_back(rank + step);
+			if(claimed[k])
+				continue;
+			collection.add(cur_boxes[k], rank + step, motion ? *motion : MotionParams());
+			cur_boxes[unclaimed++] = cur_boxes[k];
 		}
+		cur_boxes.resize(unclaimed);
+		updates.resize(collection.size(), false); 	//new boxes were not updated
 		
 		
 		//In this phase we loop through all the produced rectangles and again try to merge those whose
-		//intersection is above a certain threshold	
-		int end = collection.tracked_boxes.size();
+		//intersection is above a certain threshold. Every box absorbs, lowest index first, the following
+		//boxes it can be merged with until none is left, the absorbed box is replaced by the last one,
+		//whose update flag moves with it. The grid holds the boxes as they were before this phase under
+		//their slot, the boxes after a never change until absorbed, so it only needs the current index
+		//of every slot.
+		int end = collection.size();
+		RectGrid merge_grid(width, height, max(width/8, 1), max(height/8, 1));
+		vector<int> index_of(collection.ids.size(), -1);
+		for(int b = 0; b < end; ++b)
+		{
+			merge_grid.insert(collection.slot(b), collection.box(b));
+			index_of[collection.slot(b)] = b;
+		}
+		int reach = height/20 + 1;
 		for(int a = 0; a < end; ++a) 
 		{
-			for(int b = a + 1; b < end; ++b) 
-			{	
-				Rect_<int> removal = collection.tracked_boxes[a];
-				Rect_<int> rect    = collection.tracked_boxes[b];
-				Rect all 		   = removal | rect;
-				
-				int y_distance = height;
-				if (removal.y < rect.y)
-					y_distance = rect.y - (removal.y + removal.height);
-				else
-					y_distance = removal.y - (rect.y + rect.height);
-					
-				Rect intersection;
-				int threshold = 0;
-				if(y_distance < height/20)
-				{
-					int y_temp 	 = removal.y;
-					removal.y 	 = rect.y;
-					intersection = removal & rect;
-					threshold 	 = intersection.area();
-					if (threshold == 0)
-					{
-						int x_distance = width;
-						if (removal.x < rect.x)
-							x_distance = rect.x - (removal.x + removal.width);
-						else
-							x_distance = removal.x - (rect.x + rect.width);
-						
-						
-						//~ float area_thres = max(removal.area(), rect.area());
-						//~ if((x_distance < width/50) && (all.area() < 2*area_thres))
-						//~ {
-							//~ threshold = 1;
-						//~ }
-					}
-					removal.y 	 = y_temp;
-				}
-				if(threshold > 0)
+			while(true)
+			{
+				Rect_<int> removal = collection.box(a);
+				merge_grid.query(Rect(removal.x, removal.y - reach, removal.width, removal.height + 2*reach), candidates);
+				int b = end;
+				for(int c = 0; c < candidates.size(); ++c)
 				{
-					float rank_dif = abs(collection.tracked_rankings[a] - collection.tracked_rankings[b])/(collection.tracked_rankings[a] + collection.tracked_rankings[b]);
-					float rank_ratio = (collection.tracked_rankings[a] + collection.tracked_rankings[b])/(max_rank);
-					if(rank_ratio < 1.1)
-					{
-						collection.tracked_boxes[a] = all;
-						collection.tracked_boxes[b] = collection.tracked_boxes.back();
-						collection.tracked_boxes.pop_back();
-						
-						collection.tracked_rankings[b] = collection.tracked_rankings.back();
-						collection.tracked_rankings.pop_back();
-						
-						collection.tracked_pos[b] = collection.tracked_pos.back();
-						collection.tracked_pos.pop_back();
-						b=a;
-						--end;
-					}
+					int i = index_of[candidates[c]];
+					if(i <= a || i >= b)
+						continue;
+					float rank_ratio = (collection.rank(a) + collection.rank(i))/(max_rank);
+					if(rank_ratio < 1.1 && mergeable(removal, collection.box(i), height))
+						b = i;
 				}
+				if(b == end)
+					break;
 				
+				//a keeps its id, the last track takes the place of b
+				collection.setBox(a, removal | collection.box(b));
+				if(motion)
+					collection.filter(a).reset(collection.box(a));
+				index_of[collection.slot(b)] = -1;
+				collection.swapRemove(b);
+				--end;
+				updates[b] = updates[end];
+				updates.pop_back();
+				if(b < end)
+					index_of[collection.slot(b)] = b;
 			}
 		}	
 	}	
 	
-	//Update the rankings
-	for(int a = 0; a < collection.tracked_boxes.size(); ++a)
+	//Update the rankings, updates holds one flag per track in the order of the collection
+	for(int a = 0; a < collection.size(); ++a)
 	{
 		if (updates[a] == true)
 		{
-			if(collection.tracked_rankings[a] <= max_rank)
-				collection.tracked_rankings[a] = collection.tracked_rankings[a] + step;
+			if(collection.rank(a) <= max_rank)
+				collection.rank(a) = collection.rank(a) + step;
 		}
-		collection.tracked_rankings[a] = collection.tracked_rankings[a] - 1;
+		collection.rank(a) = collection.rank(a) - 1;
 	}
 	
-	//Delete those that fall below 0 rank
-	for(vector<float>::iterator rank_it = collection.tracked_rankings.begin(); rank_it < collection.tracked_rankings.end();)
+	//Delete those that fall below 0 rank, in one pass that keeps the order
+	vector<bool> dead(collection.size(), false);
+	for(int a = 0; a < collection.size(); ++a)
+		dead[a] = (collection.rank(a) < rank || collection.box(a).area() < rank);
+	collection.removeMarked(dead);
+}
+
+/* Mean absolute distance of every pixel of a depth Mat from z, read only */
+static double meanAbsDeviation(const Mat& src, float z)
+{
+	if(src.empty())
+		return 0.0;
+	double total = 0.0;
+	for(int y = 0; y < src.rows; ++y)
 	{
-		int dist = distance(collection.tracked_rankings.begin(), rank_it);
-		if(*rank_it < rank || collection.tracked_boxes[dist].area() < rank)
+		const float* cur = src.ptr<float>(y);
+		for(int x = 0; x < src.cols; ++x)
+			total += fabs(cur[x] - z);
+	}
+	return total/(src.rows*src.cols);
+}
+
+/* Depth, position and features of one tracked box, only its own Position
+ * is written so boxes can be processed concurrently
+ */
+static void boxFeatures(const Rect& box, Position& pos, const Mat& depth, const DepthIntegral& integral, DepthEstimator estimator, DepthDeviation deviation, Profiler* profiler)
+{
+	Mat depth_rect = depth(box);
+	try
+	{
+		//Calculating depth 
+		ScopedTimer timer(profiler, STAGE_DEPTH);
+		float z = calculateDepth(depth_rect, pos, estimator);
+		timer.stop();
+		
+		//Calculating z_diff feature
+		pos.z_diff = z - pos.z;
+		
+		if(z != 0)
+			pos.z = z;
+		
+		//Calculating Std of depth feature, see DepthDeviation
+		if(deviation == DEPTH_STD_VALID_RMS)
 		{
-			rank_it = collection.tracked_rankings.erase(rank_it);
-			collection.tracked_pos.erase(collection.tracked_pos.begin() + dist);
-			collection.tracked_boxes.erase(collection.tracked_boxes.begin() + dist);
+			pos.depth_std   = integral.deviation(box, pos.z);
+			pos.depth_valid = integral.stats(box).valid_ratio;
 		}
 		else
-			++rank_it;
-		
+			pos.depth_std = meanAbsDeviation(depth_rect, pos.z);
+	}
+	catch(exception& e)
+	{
+		printf("%s %s", "Calculate depth failed: ", e.what());
+	}
+	
+	try
+	{
+		//Calculate real world position, height, distance moved
+		Rect rect = box;
+		calculatePosition(rect, pos);
 	}
+	catch(exception& e)
+	{
+		printf("%s %s", "Calculate position failed: ", e.what());
+	}
+}
+
+/* Runs boxFeatures over a range of boxes */
+class FeaturesBody : public ParallelLoopBody
+{
+	public:
+	
+		FeaturesBody(People& collection, const Mat& depth, const DepthIntegral& integral, DepthEstimator estimator, DepthDeviation deviation, Profiler* profiler)
+		: collection(collection), depth(depth), integral(integral), estimator(estimator), deviation(deviation), profiler(profiler)
+		{
+		}
 		
+		void operator()(const Range& range) const
+		{
+			for(int i = range.start; i < range.end; ++i)
+				boxFeatures(collection.box(i), collection.pos(i), depth, integral, estimator, deviation, profiler);
+		}
+	
+	private:
+	
+		People& collection;
+		const Mat& depth;
+		const DepthIntegral& integral;
+		DepthEstimator estimator;
+		DepthDeviation deviation;
+		Profiler* profiler;
+};
+
+/* Calculates the depth, position and features of every tracked box. The
+ * boxes are split in at most max_threads stripes that run in parallel, each
+ * box only writes its own Position and kmeans is seeded for every box so the
+ * result does not depend on the scheduling.
+ * 
+ * PARAMETERS:
+ * 			- collection  : the tracked boxes, their positions are updated
+ * 			- depth 	  : the depth frame (read only)
+ * 			- integral 	  : integral images of the same depth frame, only read
+ * 							with DEPTH_STD_VALID_RMS
+ * 			- estimator   : method used for the depth of each box
+ * 			- deviation   : definition of depth_std, see DepthDeviation
+ * 			- max_threads : maximum number of stripes, 1 or less runs serially
+ * 			- profiler 	  : records the depth estimation time of every box, optional
+ * 
+ * RETURN: --
+ */
+void calculateFeatures(People& collection, const Mat& depth, const DepthIntegral& integral, DepthEstimator estimator, DepthDeviation deviation, int max_threads, Profiler* profiler)
+{
+	int boxes = collection.size();
+	FeaturesBody body(collection, depth, integral, estimator, deviation, profiler);
+	if(max_threads <= 1 || boxes < 2)
+		body(Range(0, boxes));
+	else
+		parallel_for_(Range(0, boxes), body, min(boxes, max_threads));
 }
 
 /* Calculates and stores the coordinates(x, y, z) in meters of a rectangle
@@ -567,22 +592,135 @@ void frameDif(const Mat& src1, const Mat& src2, Mat& dst, float thresh)
 	threshold(dst, dst, thresh, 255, 0);
 }
 
-/* Image gamma correction 
- *
+/* Row kernel of updateBackground, processes n bytes. The weights are 8 bit
+ * fixed point (weight/256) so the blend fits in 16 bit lanes.
+ */
+static void updateBackgroundRow(const uchar* cur, uchar* ref, uchar* dst, int n, int weight, int thresh)
+{
+	int x = 0;
+	bool simd = (thresh >= 0 && thresh < 255);
+#if defined(__AVX2__)
+	if(simd)
+	{
+		const __m256i zero  = _mm256_setzero_si256();
+		const __m256i ones  = _mm256_set1_epi8(-1);
+		const __m256i limit = _mm256_set1_epi8((char)thresh);
+		const __m256i w_cur = _mm256_set1_epi16(256 - weight);
+		const __m256i w_ref = _mm256_set1_epi16(weight);
+		for(; x <= n - 32; x += 32)
+		{
+			__m256i c = _mm256_loadu_si256((const __m256i*)(cur + x));
+			__m256i r = _mm256_loadu_si256((const __m256i*)(ref + x));
+			
+			//|cur - ref| > thresh
+			__m256i d = _mm256_or_si256(_mm256_subs_epu8(c, r), _mm256_subs_epu8(r, c));
+			__m256i m = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, limit), zero);
+			_mm256_storeu_si256((__m256i*)(dst + x), _mm256_xor_si256(m, ones));
+			
+			//cur*(1 - backFactor) + ref*backFactor, unpack and pack stay within lanes
+			__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(c, zero), w_cur),
+										  _mm256_mullo_epi16(_mm256_unpacklo_epi8(r, zero), w_ref));
+			__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(c, zero), w_cur),
+										  _mm256_mullo_epi16(_mm256_unpackhi_epi8(r, zero), w_ref));
+			_mm256_storeu_si256((__m256i*)(ref + x), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	if(simd)
+	{
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i ones  = _mm_set1_epi8(-1);
+		const __m128i limit = _mm_set1_epi8((char)thresh);
+		const __m128i w_cur = _mm_set1_epi16(256 - weight);
+		const __m128i w_ref = _mm_set1_epi16(weight);
+		for(; x <= n - 16; x += 16)
+		{
+			__m128i c = _mm_loadu_si128((const __m128i*)(cur + x));
+			__m128i r = _mm_loadu_si128((const __m128i*)(ref + x));
+			
+			__m128i d = _mm_or_si128(_mm_subs_epu8(c, r), _mm_subs_epu8(r, c));
+			__m128i m = _mm_cmpeq_epi8(_mm_subs_epu8(d, limit), zero);
+			_mm_storeu_si128((__m128i*)(dst + x), _mm_xor_si128(m, ones));
+			
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), w_cur),
+									   _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), w_ref));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), w_cur),
+									   _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), w_ref));
+			_mm_storeu_si128((__m128i*)(ref + x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+		}
+	}
+#endif
+	for(; x < n; ++x)
+	{
+		int c = cur[x];
+		int r = ref[x];
+		dst[x] = (abs(c - r) > thresh) ? 255 : 0;
+		ref[x] = (c*(256 - weight) + r*weight) >> 8;
+	}
+}
+
+/* Running average background update fused with frameDif. In a single sweep it
+ * thresholds the absolute difference of the current frame from the reference
+ * and then blends the current frame into the reference:
+ * 			dst = |cur - ref| > thresh ? 255 : 0
+ * 			ref = cur*(1 - backFactor) + ref*backFactor
+ * Uses AVX2/SSE2 when available with fixed point weights (1/256 steps).
+ * 
  * PARAMETERS:
- * 			- src: Mat to perform gamma correction
+ * 			- cur 		 : the current frame
+ * 			- ref 		 : the reference (background) frame, updated in place
+ * 			- dst 		 : destination Mat of the thresholded difference
+ * 			- backFactor : weight of the reference in the running average
+ * 			- thresh 	 : threshold to be used
  * 
  * RETURN: --
  */
-void gammaCorrection(const Mat& src, float factor)
+void updateBackground(const Mat& cur, Mat& ref, Mat& dst, float backFactor, float thresh)
 {
+	dst.create(cur.rows, cur.cols, cur.type());
+	int weight 	 = min(max(cvRound(backFactor*256), 0), 256);
+	int limit 	 = min(max(int(floor(thresh)), -1), 255);
+	int rows 	 = cur.rows;
+	int cols 	 = cur.cols*cur.channels();
+	if(cur.isContinuous() && ref.isContinuous() && dst.isContinuous())
+	{
+		cols *= rows;
+		rows = 1;
+	}
+	for(int y = 0; y < rows; ++y)
+		updateBackgroundRow(cur.ptr<uchar>(y), ref.ptr<uchar>(y), dst.ptr<uchar>(y), cols, weight, limit);
+}
 
-	float inverse_gamma = 1.0/2.5;
-	Mat lut_matrix(256, 1, CV_8UC1);
-	uchar* ptr = lut_matrix.ptr<uchar>(0);
+/* Builds the lookup table of a gamma correction
+ *
+ * PARAMETERS:
+ * 			- lut 	 : Mat to store the 256 entries table
+ * 			- factor : the gamma factor
+ *
+ * RETURN: --
+ */
+void gammaLut(Mat& lut, float factor)
+{
+	float inverse_gamma = 1.0/factor;
+	lut.create(256, 1, CV_8UC1);
+	uchar* ptr = lut.ptr<uchar>(0);
 	for( int i = 0; i < 256; ++i)
 		ptr[i] =  saturate_cast<uchar>(pow(i/255.0, inverse_gamma)*255.0);
-	LUT(src, lut_matrix, src);
 }
 
-
+/* Image gamma correction, for repeated use prefer ImagePreprocessor
+ * that keeps the lookup table
+ *
+ * PARAMETERS:
+ * 			- src	 : Mat to perform gamma correction
+ * 			- factor : the gamma factor
+ * 
+ * RETURN: --
+ */
+void gammaCorrection(const Mat& src, float factor)
+{
+	Mat lut_matrix;
+	gammaLut(lut_matrix, factor);
+	LUT(src, lut_matrix, src);
+}
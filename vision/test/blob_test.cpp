@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <vision.hpp>
+#include <rect_grid.hpp>
+#include <motion_model.hpp>
+
+/* A 40x40 difference with one 6x6 moving square at (10, 12) */
+static Mat squareDifference()
+{
+	Mat dif(40, 40, CV_8UC1, Scalar(0));
+	for(int y = 12; y < 18; ++y)
+		for(int x = 10; x < 16; ++x)
+			dif.ptr<uchar>(y)[x] = 255;
+	return dif;
+}
+
+TEST(DetectBlobs, FindsSquare)
+{
+	vector< Rect_<int> > blobs;
+	detectBlobs(squareDifference(), blobs, 3, 1, false);
+	ASSERT_EQ(blobs.size(), 1u);
+	EXPECT_EQ(blobs[0], Rect_<int>(10, 12, 8, 8));
+}
+
+TEST(DetectBlobs, ZeroRangeIsOnePixel)
+{
+	vector< Rect_<int> > expected, zero, negative;
+	detectBlobs(squareDifference(), expected, 1, 1, false);
+	detectBlobs(squareDifference(), zero, 0, 1, false);
+	detectBlobs(squareDifference(), negative, -4, 1, false);
+	ASSERT_FALSE(expected.empty());
+	Rect_<int> covered = expected[0];
+	for(int b = 1; b < expected.size(); ++b)
+		covered |= expected[b];
+	EXPECT_EQ(covered, Rect_<int>(10, 12, 6, 6));
+	EXPECT_EQ(zero, expected);
+	EXPECT_EQ(negative, expected);
+}
+
+TEST(DetectBlobs, EmptyDifference)
+{
+	vector< Rect_<int> > blobs;
+	detectBlobs(Mat(40, 40, CV_8UC1, Scalar(0)), blobs, 0, 1, false);
+	EXPECT_TRUE(blobs.empty());
+}
+
+TEST(RectGrid, ZeroSizeQuery)
+{
+	RectGrid grid(40, 40, 10, 10);
+	grid.insert(0, Rect(10, 12, 6, 6));
+	grid.insert(1, Rect(30, 30, 5, 5));
+	vector<int> found;
+	grid.query(Rect(12, 14, 0, 0), found);
+	ASSERT_EQ(found.size(), 1u);
+	EXPECT_EQ(found[0], 0);
+	grid.query(Rect(12, 14, -3, -3), found);
+	ASSERT_EQ(found.size(), 1u);
+	EXPECT_EQ(found[0], 0);
+}
+
+TEST(BoxFilter, ResetKeepsVelocityAndCovariance)
+{
+	MotionParams params;
+	BoxFilter filter;
+	filter.init(Rect_<int>(10, 10, 20, 40), params);
+	filter.predict(params);
+	filter.update(Rect_<int>(14, 10, 20, 40), params);
+	BoxFilter merged = filter;
+	merged.reset(Rect_<int>(0, 0, 60, 50));
+	EXPECT_EQ(Rect_<int>(0, 0, 60, 50), merged.box());
+	EXPECT_FLOAT_EQ(filter.vx, merged.vx);
+	EXPECT_FLOAT_EQ(filter.pxx, merged.pxx);
+	EXPECT_FLOAT_EQ(filter.pvvx, merged.pvvx);
+	EXPECT_FLOAT_EQ(filter.pw, merged.pw);
+	EXPECT_EQ(filter.age, merged.age);
+}
+
+int main(int argc, char** argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
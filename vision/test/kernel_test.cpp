@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include <vision.hpp>
+#include <limits>
+
+/* Odd widths so the SIMD loops leave a scalar tail, 53 also runs the SSE2
+ * loop after the AVX2 one */
+static const int widths[] = {1, 15, 37, 53, 641};
+
+/* The scalar fixed point blend of updateBackground */
+static void blendReference(const Mat& cur, Mat& ref, float backFactor)
+{
+	int weight = min(max(cvRound(backFactor*256), 0), 256);
+	for(int y = 0; y < cur.rows; ++y)
+		for(int x = 0; x < cur.cols*cur.channels(); ++x)
+		{
+			int c = cur.ptr<uchar>(y)[x];
+			int r = ref.ptr<uchar>(y)[x];
+			ref.ptr<uchar>(y)[x] = (c*(256 - weight) + r*weight) >> 8;
+		}
+}
+
+/* Runs updateBackground on random frames and compares the mask with frameDif
+ * and the new reference with the scalar blend
+ */
+static void checkBackground(const Mat& cur, const Mat& ref, float backFactor, float thresh)
+{
+	Mat expected_dst, expected_ref = ref.clone();
+	frameDif(cur, ref, expected_dst, thresh);
+	blendReference(cur, expected_ref, backFactor);
+
+	Mat dst, updated = ref.clone();
+	updateBackground(cur, updated, dst, backFactor, thresh);
+	ASSERT_EQ(dst.size(), cur.size());
+	EXPECT_EQ(countNonZero(dst.reshape(1) != expected_dst.reshape(1)), 0) << "mask, width " << cur.cols << " backFactor " << backFactor << " thresh " << thresh;
+	EXPECT_EQ(countNonZero(updated.reshape(1) != expected_ref.reshape(1)), 0) << "reference, width " << cur.cols << " backFactor " << backFactor << " thresh " << thresh;
+}
+
+TEST(UpdateBackground, MatchesScalar)
+{
+	const float factors[] = {0.0, 0.3, 0.75, 0.999, 1.0};
+	const float threshs[] = {-3.0, 0.0, 40.5, 84.15, 254.0, 255.0};
+	RNG rng(7);
+	for(int w = 0; w < sizeof(widths)/sizeof(widths[0]); ++w)
+		for(int f = 0; f < sizeof(factors)/sizeof(factors[0]); ++f)
+			for(int t = 0; t < sizeof(threshs)/sizeof(threshs[0]); ++t)
+			{
+				Mat cur(5, widths[w], CV_8UC1), ref(5, widths[w], CV_8UC1);
+				rng.fill(cur, RNG::UNIFORM, 0, 256);
+				rng.fill(ref, RNG::UNIFORM, 0, 256);
+				checkBackground(cur, ref, factors[f], threshs[t]);
+			}
+}
+
+TEST(UpdateBackground, MatchesScalarOnRowViews)
+{
+	//Not continuous, every row runs its own tail
+	RNG rng(11);
+	for(int w = 0; w < sizeof(widths)/sizeof(widths[0]); ++w)
+	{
+		Mat cur_full(6, widths[w] + 9, CV_8UC3), ref_full(6, widths[w] + 9, CV_8UC3);
+		rng.fill(cur_full, RNG::UNIFORM, 0, 256);
+		rng.fill(ref_full, RNG::UNIFORM, 0, 256);
+		Rect view(3, 1, widths[w], 4);
+		checkBackground(cur_full(view), ref_full(view), 0.6, 30);
+	}
+}
+
+/* The per pixel formula depthToGray replaced, clamped where it overflowed */
+static uchar oldDepthToGray(float depth, float min_depth, float max_depth)
+{
+	float v = 255*((depth - min_depth)/(max_depth - min_depth));
+	if(!(v > 0.0f))
+		return 0;
+	return (v >= 255.0f) ? 255 : (uchar)v;
+}
+
+/* Every 16 bit value in rows of an odd width view, padding repeats values */
+static Mat allDepths(int type, int width)
+{
+	int rows = (65536 + width - 1)/width;
+	Mat full(rows, width + 3, type);
+	for(int y = 0; y < rows; ++y)
+		for(int x = 0; x < width; ++x)
+		{
+			int d = (y*width + x) % 65536;
+			if(type == CV_16UC1)
+				full.ptr<ushort>(y)[x] = d;
+			else
+				full.ptr<float>(y)[x] = d;
+		}
+	return full(Rect(0, 0, width, rows));
+}
+
+/* Compares depthToGray with the old formula on every 16 bit depth */
+static void checkDepthToGray(int type, float min_depth, float max_depth)
+{
+	for(int w = 0; w < sizeof(widths)/sizeof(widths[0]); ++w)
+	{
+		Mat depth = allDepths(type, widths[w]);
+		Mat gray;
+		depthToGray(depth, gray, min_depth, max_depth);
+		ASSERT_EQ(gray.size(), depth.size());
+		int wrong = 0;
+		for(int y = 0; y < depth.rows; ++y)
+			for(int x = 0; x < depth.cols; ++x)
+			{
+				float d = (type == CV_16UC1) ? depth.ptr<ushort>(y)[x] : depth.ptr<float>(y)[x];
+				if(gray.ptr<uchar>(y)[x] != oldDepthToGray(d, min_depth, max_depth) && wrong++ < 3)
+					ADD_FAILURE() << "depth " << d << " range [" << min_depth << ", " << max_depth << "] width " << widths[w];
+			}
+		EXPECT_EQ(wrong, 0);
+	}
+}
+
+TEST(DepthToGray, FloatMatchesOldFormula)
+{
+	//The default range, sub mm bounds and ranges past the 16 bit values
+	const float ranges[][2] = {{0, 8000}, {450, 4500}, {300.5, 7000.25}, {0, 65535}, {1000, 1001}, {20000, 90000}};
+	for(int r = 0; r < sizeof(ranges)/sizeof(ranges[0]); ++r)
+		checkDepthToGray(CV_32FC1, ranges[r][0], ranges[r][1]);
+}
+
+TEST(DepthToGray, NativeMatchesOldFormula)
+{
+	//Whole mm bounds, the range is rounded to them. Short, 16 bit lane and wider ranges
+	const float ranges[][2] = {{0, 8000}, {450, 4500}, {0, 200}, {0, 65535}, {1000, 1001}, {123, 32890}};
+	for(int r = 0; r < sizeof(ranges)/sizeof(ranges[0]); ++r)
+		checkDepthToGray(CV_16UC1, ranges[r][0], ranges[r][1]);
+}
+
+TEST(DepthToGray, FloatOutOfRange)
+{
+	//Missing and out of range depths, on both sides of the 16 value SIMD blocks
+	const float nan = numeric_limits<float>::quiet_NaN();
+	const float inf = numeric_limits<float>::infinity();
+	const float values[] = {nan, inf, -inf, -5, 0, 1e30, -1e30, 100, 8001, 7999.9, nan, inf, -inf, 99.9, 8000, 1e30, 50, nan, inf};
+	const uchar expected[] = {0, 255, 0, 0, 0, 255, 0, 0, 255, 254, 0, 255, 0, 0, 255, 255, 0, 0, 255};
+	Mat depth(1, 19, CV_32FC1, (void*)values);
+	Mat gray;
+	depthToGray(depth, gray, 100, 8000);
+	for(int x = 0; x < depth.cols; ++x)
+		EXPECT_EQ(gray.ptr<uchar>(0)[x], expected[x]) << "depth " << values[x];
+}
+
+TEST(DepthToGray, NativeOutOfRange)
+{
+	const ushort values[] = {0, 65535, 99, 100, 8000, 8001, 30000, 1, 0, 65535, 7999, 4050, 65000, 0, 8000, 99, 101, 0, 9000};
+	Mat depth(1, 19, CV_16UC1, (void*)values);
+	Mat gray;
+	depthToGray(depth, gray, 100, 8000);
+	for(int x = 0; x < depth.cols; ++x)
+		EXPECT_EQ(gray.ptr<uchar>(0)[x], oldDepthToGray(values[x], 100, 8000)) << "depth " << values[x];
+}
+
+TEST(GrayToDepth, MatchesOldFormula)
+{
+	const float max_depths[] = {8000, 4500.5, 65535};
+	Mat gray(1, 256, CV_8UC1);
+	for(int g = 0; g < 256; ++g)
+		gray.ptr<uchar>(0)[g] = g;
+	for(int m = 0; m < sizeof(max_depths)/sizeof(max_depths[0]); ++m)
+	{
+		Mat depth;
+		grayToDepth(gray, depth, max_depths[m]);
+		for(int g = 0; g < 256; ++g)
+			EXPECT_EQ(depth.ptr<float>(0)[g], float(max_depths[m]*(float(g)/(255.0)))) << "gray " << g;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}